@@ -0,0 +1,80 @@
+#!/bin/bash
+#
+# Label cardinality and key length study.
+# Runs the labels role over a grid of label counts, label lengths and
+# product type name lengths against a single bedrock service, and
+# reports store/load latency together with the server's resident memory
+# growth per stored key (sampled from /proc, so the service must run on
+# this host).
+#
+# Usage: ./labels.sh
+# Environment: RANKS (default 1), MPIEXEC (default mpirun), EVENTS (default 1000),
+#              COUNTS (default "1 10 100"), LENGTHS (default "8 32 128"),
+#              TYPE_NAMES (default "short medium long")
+
+set -e
+trap 'kill $(jobs -p) 2> /dev/null' EXIT
+
+RANKS=${RANKS:-1}
+MPIEXEC=${MPIEXEC:-mpirun}
+EVENTS=${EVENTS:-1000}
+COUNTS=${COUNTS:-1 10 100}
+LENGTHS=${LENGTHS:-8 32 128}
+TYPE_NAMES=${TYPE_NAMES:-short medium long}
+BENCHMARK=../build/hepnos-icarus-benchmark
+
+rm -rf hepnos.ssg dbs.json core labels
+mkdir labels
+
+echo "Starting HEPnOS"
+bedrock ofi+tcp -c hepnos.json -v info &> bedrock-logs.txt &
+BEDROCK_PID=$!
+
+echo "Waiting for SSG file"
+while [ ! -f hepnos.ssg ]; do sleep 1; done
+sleep 1
+
+echo "Querying databases"
+hepnos-list-databases ofi+tcp -s hepnos.ssg > dbs.json
+
+function server_rss_kb {
+    grep VmRSS /proc/$BEDROCK_PID/status | awk '{ print $2 }'
+}
+
+# field <logfile> <pattern> <key> extracts a value from the last line matching pattern
+function field {
+    grep "$2" $1 | tail -n 1 | tr ' ' '\n' | grep "^$3=" | cut -d= -f2
+}
+
+printf "%8s %8s %8s %10s %12s %12s %14s\n" \
+    labels length type key_bytes "store-lat(s)" "load-lat(s)" "server_B/key"
+for count in $COUNTS; do
+for length in $LENGTHS; do
+for type in $TYPE_NAMES; do
+    log=labels/$count-$length-$type.txt
+    rss_before=$(server_rss_kb)
+    $MPIEXEC -np $RANKS $BENCHMARK \
+        --protocol ofi+tcp \
+        --verbose info \
+        --product-sizes 128 \
+        --label hepnos \
+        --dataset labels-$count-$length-$type \
+        --role labels \
+        --num-events $EVENTS \
+        --label-count $count \
+        --label-length $length \
+        --type-name $type \
+        --no-shutdown \
+        --connection dbs.json &> $log
+    rss_after=$(server_rss_kb)
+    keys=$(field $log "labels count" keys)
+    printf "%8s %8s %8s %10s %12s %12s %14s\n" $count $length $type \
+        $(field $log "labels count" key_suffix_bytes) \
+        $(field $log "phase=label_store " latency_avg) \
+        $(field $log "phase=label_load " latency_avg) \
+        $(awk -v b=$rss_before -v a=$rss_after -v k=$keys 'BEGIN { if(k > 0) printf "%.1f", (a-b)*1024/k; else print 0 }')
+done
+done
+done
+
+echo "Benchmark completed"
@@ -0,0 +1,124 @@
+#!/bin/bash
+#
+# Multi-tenant interference benchmark.
+# Launches K independent benchmark instances against a single bedrock
+# service, first each tenant alone, then all tenants at the same time,
+# and compares per-tenant throughput and latency between the two.
+#
+# Usage: ./multitenant.sh name:role[:product-sizes] [name:role[:product-sizes] ...]
+#   role is one of writer, reader, scanner
+#   e.g. ./multitenant.sh raw:writer reco:reader:1024,4096 ana:scanner
+#
+# Environment: RANKS (processes per tenant, default 1), MPIEXEC (default mpirun),
+#              EVENTS (events per rank, default 20000, large enough for the
+#              concurrent runs to overlap), EXTRA_ARGS (passed to every tenant)
+
+set -e
+trap 'kill $(jobs -p) 2> /dev/null' EXIT
+
+RANKS=${RANKS:-1}
+MPIEXEC=${MPIEXEC:-mpirun}
+EVENTS=${EVENTS:-20000}
+EXTRA_ARGS=${EXTRA_ARGS:-}
+BENCHMARK=../build/hepnos-icarus-benchmark
+DEFAULT_SIZES=128,256,512
+
+if [ "$#" -eq 0 ]; then
+    echo "Usage: $0 name:role[:product-sizes] ..."
+    exit 1
+fi
+
+rm -rf hepnos.ssg dbs.json core tenants
+mkdir tenants
+
+echo "Starting HEPnOS"
+bedrock ofi+tcp -c hepnos.json -v info &> bedrock-logs.txt &
+
+echo "Waiting for SSG file"
+while [ ! -f hepnos.ssg ]; do sleep 1; done
+sleep 1
+
+echo "Querying databases"
+hepnos-list-databases ofi+tcp -s hepnos.ssg > dbs.json
+
+# run_tenant <name> <role> <sizes> <dataset> <logfile>
+function run_tenant {
+    $MPIEXEC -np $RANKS $BENCHMARK \
+        --protocol ofi+tcp \
+        --verbose info \
+        --product-sizes $3 \
+        --label hepnos \
+        --dataset $4 \
+        --role $2 \
+        --num-events $EVENTS \
+        --no-shutdown \
+        --connection dbs.json \
+        $EXTRA_ARGS &> $5
+}
+
+# writers get a fresh dataset for each run, readers and scanners
+# work on a dataset populated ahead of time
+function tenant_dataset {
+    if [ "$2" == "writer" ]; then echo "$1-$3"; else echo "$1"; fi
+}
+
+for tenant in "$@"; do
+    IFS=: read name role sizes <<< "$tenant"
+    sizes=${sizes:-$DEFAULT_SIZES}
+    if [ "$role" != "writer" ]; then
+        echo "Populating dataset $name for tenant $name"
+        run_tenant $name writer $sizes $name tenants/$name-populate.txt
+    fi
+done
+
+for tenant in "$@"; do
+    IFS=: read name role sizes <<< "$tenant"
+    sizes=${sizes:-$DEFAULT_SIZES}
+    echo "Running tenant $name ($role) alone"
+    run_tenant $name $role $sizes $(tenant_dataset $name $role alone) tenants/$name-alone.txt
+done
+
+echo "Running all tenants concurrently"
+pids=""
+for tenant in "$@"; do
+    IFS=: read name role sizes <<< "$tenant"
+    sizes=${sizes:-$DEFAULT_SIZES}
+    run_tenant $name $role $sizes $(tenant_dataset $name $role shared) tenants/$name-shared.txt &
+    pids="$pids $!"
+done
+# wait on each tenant so that any failure is noticed, not only the last one
+failed=0
+for pid in $pids; do
+    wait $pid || failed=1
+done
+if [ $failed -ne 0 ]; then
+    echo "At least one tenant failed, see tenants/*-shared.txt"
+    exit 1
+fi
+
+# field <logfile> <key> extracts a value from the last summary line
+function field {
+    grep "summary" $1 | tail -n 1 | tr ' ' '\n' | grep "^$2=" | cut -d= -f2
+}
+
+echo "Per-tenant comparison (alone vs. shared)"
+printf "%-16s %-8s %12s %12s %10s %14s %14s\n" \
+    tenant role "alone-ops/s" "shared-ops/s" slowdown "alone-lat(s)" "shared-lat(s)"
+ratios=""
+for tenant in "$@"; do
+    IFS=: read name role sizes <<< "$tenant"
+    alone=$(field tenants/$name-alone.txt "ops/s")
+    shared=$(field tenants/$name-shared.txt "ops/s")
+    alone_lat=$(field tenants/$name-alone.txt latency_avg)
+    shared_lat=$(field tenants/$name-shared.txt latency_avg)
+    slowdown=$(awk -v a=$alone -v s=$shared 'BEGIN { if(s > 0) printf "%.3f", a/s; else print "inf" }')
+    ratios="$ratios $(awk -v a=$alone -v s=$shared 'BEGIN { if(a > 0) print s/a; else print 0 }')"
+    printf "%-16s %-8s %12s %12s %10s %14s %14s\n" \
+        $name $role $alone $shared $slowdown $alone_lat $shared_lat
+done
+
+# Jain's fairness index over the normalized (shared/alone) throughputs
+echo $ratios | awk '{ s = 0; q = 0; for(i = 1; i <= NF; i++) { s += $i; q += $i*$i }
+                     if(q > 0) printf "Jain fairness index: %.3f\n", (s*s)/(NF*q) }'
+
+echo "Benchmark completed"
@@ -5,14 +5,46 @@
 #include <fstream>
 #include <string>
 #include <random>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/fmt/ostr.h>
 #include <tclap/CmdLine.h>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/serialization/vector.hpp>
 #include <hepnos.hpp>
+#include <abt.h>
 #include "DummyProduct.hpp"
+#include "LRUProductCache.hpp"
+#include "HugePageBuffer.hpp"
+#include "ComputeKernels.hpp"
+#include "SampleDump.hpp"
+#include "NamedProducts.hpp"
+#ifdef HEPNOS_BENCHMARK_COROUTINES
+#include "CoroutineScheduler.hpp"
+#endif
 
 static int                       g_size;
 static int                       g_rank;
+static MPI_Comm                  g_node_comm;
+static int                       g_node_size;
+static int                       g_node_rank;
+static MPI_Comm                  g_leader_comm;
 static std::string               g_protocol;
 static std::string               g_connection_file;
 static std::string               g_margo_file;
@@ -22,13 +54,180 @@ static std::vector<size_t>       g_product_sizes;
 static spdlog::level::level_enum g_logging_level;
 static unsigned                  g_num_threads;
 static std::pair<double,double>  g_wait_range;
+static std::string               g_role;
+static bool                      g_no_shutdown;
+static bool                      g_calibrate;
+static std::string               g_derived_label;
+static double                    g_derived_ratio;
+static std::string               g_derived_store;
+static std::string               g_create_pattern;
+static size_t                    g_num_runs;
+static bool                      g_per_node_details;
+static std::string               g_skew;
+static double                    g_skew_factor;
+static bool                      g_scan_pep;
+static double                    g_spill_period;
+static double                    g_duty_cycle;
+static size_t                    g_events_per_spill;
+static std::string               g_compute;
+static unsigned                  g_compute_passes;
+static size_t                    g_compute_bytes;
+static size_t                    g_num_events;
+static size_t                    g_max_inflight_bytes;
+static bool                      g_load_by_id;
+static size_t                    g_cache_bytes;
+static size_t                    g_reuse_distance;
+static unsigned                  g_reread_count;
+static bool                      g_aggregate;
+static size_t                    g_aggregation_batch;
+static bool                      g_shared_buffers;
+static MPI_Win                   g_products_win = MPI_WIN_NULL;
+static MPI_Win                   g_read_win = MPI_WIN_NULL;
+static char*                     g_read_buffer = nullptr;
+static size_t                    g_read_buffer_size = 0;
+static std::string               g_huge_pages;
+static std::unique_ptr<HugePageBuffer> g_products_buffer;
+static std::unique_ptr<HugePageBuffer> g_read_huge_buffer;
+static long                      g_last_page_faults = 0;
+static std::string               g_driver;
+static unsigned                  g_concurrency;
+static unsigned                  g_io_threads;
+static unsigned                  g_workers;
+static size_t                    g_switch_iterations;
+static std::string               g_sample_prefix;
+static size_t                    g_label_count;
+static double                    g_selection_fraction;
+static size_t                    g_num_datasets;
+static unsigned                  g_client_instances;
+static unsigned                  g_virtual_clients;
+static std::string               g_export_prefix;
+static size_t                    g_export_buffer_size;
+static size_t                    g_summary_size;
+static size_t                    g_label_length;
+static std::string               g_type_name;
+static double                    g_time_origin = 0.0;
 static std::mt19937              g_mte;
 
+struct calibration_results {
+    bool   done             = false;
+    double mpi_latency      = 0.0;
+    double mpi_bandwidth    = 0.0;
+    double memcpy_bandwidth = 0.0;
+    double rpc_latency      = 0.0;
+    int    num_nodes        = 1;
+};
+static calibration_results       g_calibration;
+
+struct phase_stats {
+    size_t num_ops     = 0;
+    size_t num_bytes   = 0;
+    double latency_sum = 0.0;
+    double latency_max = 0.0;
+    uint8_t op         = op_other;
+    sample_columns samples; // only filled with --dump-samples
+
+    void add(size_t bytes, double latency, double stat1 = NAN, double stat2 = NAN) {
+        num_ops     += 1;
+        num_bytes   += bytes;
+        latency_sum += latency;
+        latency_max  = std::max(latency_max, latency);
+        if(!g_sample_prefix.empty()) {
+            double end = MPI_Wtime() - g_time_origin;
+            samples.push(sample_columns::thread_index(), op, bytes, end - latency, end, stat1, stat2);
+        }
+    }
+
+    void merge(const phase_stats& other) {
+        num_ops     += other.num_ops;
+        num_bytes   += other.num_bytes;
+        latency_sum += other.latency_sum;
+        latency_max  = std::max(latency_max, other.latency_max);
+        samples.append(other.samples);
+    }
+};
+
 static void parse_arguments(int argc, char** argv);
 static std::pair<double,double> parse_wait_range(const std::string&);
 static std::string check_file_exists(const std::string& filename);
 static std::vector<size_t> parse_product_sizes(const std::string&);
 static void run_benchmark();
+static hepnos::Run open_run(hepnos::DataStore& datastore, bool create,
+                            const std::string& dataset_name = g_input_dataset);
+static hepnos::DataSet open_dataset(hepnos::DataStore& datastore,
+                                    const std::string& dataset_name = g_input_dataset);
+static std::vector<dummy_product> create_products();
+static void attach_read_buffer(dummy_product& product);
+static void report_memory();
+static void run_store_phase(hepnos::Run& run, const std::vector<dummy_product>& products,
+                            std::vector<hepnos::ProductID>& product_ids);
+static void run_bounded_store_phase(hepnos::AsyncEngine& async, hepnos::Run& run,
+                                    const std::vector<dummy_product>& products,
+                                    std::vector<hepnos::ProductID>& product_ids);
+static void run_load_by_id_phase(hepnos::DataStore& datastore,
+                                 const std::vector<dummy_product>& products,
+                                 const std::vector<hepnos::ProductID>& product_ids);
+static std::vector<hepnos::ProductID> exchange_product_ids(const std::vector<hepnos::ProductID>& ids);
+static long get_max_rss_kb();
+static long get_pss_kb();
+static void reset_peak_rss();
+static long get_peak_rss_kb();
+static long get_page_faults();
+static size_t packed_size(hepnos::EventNumber first, hepnos::EventNumber last);
+static int packed_count(hepnos::EventNumber first, hepnos::EventNumber last);
+static void run_aggregated_store_phase(hepnos::DataStore& datastore, hepnos::Run& run,
+                                       const std::vector<dummy_product>& products);
+static void run_aggregated_load_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_load_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_scan_phase(hepnos::DataStore& datastore);
+static void run_pep_scan_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async);
+static void run_export_phase(hepnos::DataStore& datastore);
+static void apply_skew();
+static void run_spill_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_lookup_phase(hepnos::DataStore& datastore, hepnos::Run& run);
+static double run_reread_phase(hepnos::Run& run, LRUProductCache* cache);
+static double draw_wait_time(std::mt19937& mte);
+static void run_compute_kernel(const dummy_product& product);
+static void simulate_compute(const dummy_product& product, std::mt19937& mte);
+static void run_pipeline_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void store_and_load_back(const hepnos::SubRun& subrun, hepnos::EventNumber evn,
+                                const dummy_product& product, dummy_product& tmp_product);
+static void run_threads_driver(const hepnos::SubRun& subrun,
+                               const std::vector<dummy_product>& products,
+                               std::atomic<hepnos::EventNumber>& next_event,
+                               std::vector<phase_stats>& lane_stats);
+static void run_ults_driver(const hepnos::SubRun& subrun,
+                            const std::vector<dummy_product>& products,
+                            std::atomic<hepnos::EventNumber>& next_event,
+                            std::vector<phase_stats>& lane_stats);
+static double measure_ult_switch_time();
+static double measure_thread_switch_time();
+static void report_switch_time();
+#ifdef HEPNOS_BENCHMARK_COROUTINES
+static CoroutineScheduler::Task pipeline_coroutine(CoroutineScheduler& sched,
+                                                   const hepnos::SubRun& subrun,
+                                                   const std::vector<dummy_product>& products,
+                                                   std::atomic<hepnos::EventNumber>& next_event,
+                                                   phase_stats& stats, unsigned seed);
+#endif
+static void run_calibration(hepnos::DataStore& datastore);
+static void run_create_phase(hepnos::DataStore& datastore);
+static void run_hot_phase(hepnos::DataStore& datastore, hepnos::Run& run,
+                          const std::vector<dummy_product>& products);
+static std::vector<std::string> make_labels();
+static bool is_selected(hepnos::EventNumber evn);
+static void run_correlated_phase(hepnos::DataStore& datastore, const std::vector<dummy_product>& products);
+static void run_multiclient_phase(hepnos::DataStore& datastore, const std::vector<dummy_product>& products);
+static void run_virtual_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_skim_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async,
+                           hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_labels_phase(hepnos::Run& run, const std::vector<dummy_product>& products);
+static void run_derive_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async, hepnos::Run& run);
+static double measure_phase(const std::string& name, uint8_t op,
+                            const std::function<void(phase_stats&)>& body);
+static double measure_events(const std::string& name, uint8_t op,
+                             const std::function<size_t(hepnos::EventNumber)>& body);
+static double report_phase(const std::string& phase, const phase_stats& stats, double elapsed);
+static void report_nodes(const std::string& phase, const phase_stats& stats, double elapsed);
 
 int main(int argc, char** argv) {
 
@@ -36,6 +235,10 @@ int main(int argc, char** argv) {
     MPI_Init_thread(&argc, &argv, required, &provided);
     MPI_Comm_size(MPI_COMM_WORLD, &g_size);
     MPI_Comm_rank(MPI_COMM_WORLD, &g_rank);
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, g_rank, MPI_INFO_NULL, &g_node_comm);
+    MPI_Comm_size(g_node_comm, &g_node_size);
+    MPI_Comm_rank(g_node_comm, &g_node_rank);
+    MPI_Comm_split(MPI_COMM_WORLD, g_node_rank == 0 ? 0 : MPI_UNDEFINED, g_rank, &g_leader_comm);
 
     std::stringstream str_format;
     str_format << "[" << std::setw(6) << std::setfill('0') << g_rank << "|" << g_size
@@ -46,6 +249,8 @@ int main(int argc, char** argv) {
 
     spdlog::set_level(g_logging_level);
 
+    apply_skew();
+
     if(provided != required && g_rank == 0) {
         spdlog::warn("MPI doesn't provider MPI_THREAD_MULTIPLE");
     }
@@ -55,14 +260,49 @@ int main(int argc, char** argv) {
     spdlog::trace("product label: {}", g_product_label);
     spdlog::trace("num threads: {}", g_num_threads);
     spdlog::trace("wait range: {},{}", g_wait_range.first, g_wait_range.second);
+    spdlog::trace("role: {}", g_role);
+    spdlog::trace("calibrate: {}", g_calibrate);
+    spdlog::trace("derived product: label={}, ratio={}, store={}",
+                  g_derived_label, g_derived_ratio, g_derived_store);
+    spdlog::trace("create pattern: {} ({} runs)", g_create_pattern, g_num_runs);
+    spdlog::trace("skew: {} (factor {})", g_skew, g_skew_factor);
+    spdlog::trace("scan with PEP: {}", g_scan_pep);
+    spdlog::trace("spills: period={}, duty cycle={}, events per spill={}",
+                  g_spill_period, g_duty_cycle, g_events_per_spill);
+    spdlog::trace("compute: {} ({} passes, {} stream bytes)", g_compute, g_compute_passes, g_compute_bytes);
+    spdlog::trace("num events: {}", g_num_events);
+    spdlog::trace("max inflight bytes: {}", g_max_inflight_bytes);
+    spdlog::trace("load by id: {}", g_load_by_id);
+    spdlog::trace("cache bytes: {}", g_cache_bytes);
+    spdlog::trace("reuse distance: {}", g_reuse_distance);
+    spdlog::trace("aggregate: {} (batch of {} events)", g_aggregate, g_aggregation_batch);
+    spdlog::trace("shared buffers: {}", g_shared_buffers);
+    spdlog::trace("huge pages: {}", g_huge_pages);
+    spdlog::trace("driver: {} (concurrency {}, {} I/O threads)", g_driver, g_concurrency, g_io_threads);
+    spdlog::trace("coroutine workers: {}", g_workers);
+    spdlog::trace("switch iterations: {}", g_switch_iterations);
+    spdlog::trace("sample dump prefix: {}", g_sample_prefix);
+    spdlog::trace("export: prefix={}, buffer size={}", g_export_prefix, g_export_buffer_size);
+    spdlog::trace("virtual clients: {}", g_virtual_clients);
+    spdlog::trace("client instances: {}", g_client_instances);
+    spdlog::trace("correlated datasets: {}", g_num_datasets);
+    spdlog::trace("skim: selection fraction={}, summary size={}", g_selection_fraction, g_summary_size);
+    spdlog::trace("labels: count={}, length={}, type name={}", g_label_count, g_label_length, g_type_name);
 
     MPI_Barrier(MPI_COMM_WORLD);
+    g_time_origin = MPI_Wtime();
+    if(!g_sample_prefix.empty()) {
+        // phases append their blocks, start from an empty file
+        std::ofstream(g_sample_prefix + "." + std::to_string(g_rank) + ".bin", std::ios::binary | std::ios::trunc);
+    }
 
     spdlog::trace("Initializing RNG");
     g_mte = std::mt19937(g_rank);
 
     run_benchmark();
 
+    if(g_leader_comm != MPI_COMM_NULL) MPI_Comm_free(&g_leader_comm);
+    MPI_Comm_free(&g_node_comm);
     MPI_Finalize();
     return 0;
 }
@@ -94,6 +334,136 @@ static void parse_arguments(int argc, char** argv) {
             "Number of threads to run processing work", false, 0, "int");
         TCLAP::ValueArg<std::string> waitRange("r", "wait-range",
             "Waiting time interval in seconds (e.g. 1.34,3.56)", false, "0,0", "x,y");
+        std::vector<std::string> roles = {
+            "all", "writer", "reader", "scanner", "lookup", "reread", "pipeline", "derive", "create",
+            "hot", "spill", "labels", "skim", "correlated", "multiclient", "virtual", "export" };
+        std::string role_list;
+        for(const auto& r : roles)
+            role_list += (role_list.empty() ? "" : ", ") + r;
+        TCLAP::ValuesConstraint<std::string> allowedRoles( roles );
+        TCLAP::ValueArg<std::string> role("", "role",
+            "Workload to run against the dataset (" + role_list + ")", false, "all",
+            &allowedRoles);
+        TCLAP::ValueArg<size_t> numEvents("n", "num-events",
+            "Number of events per rank, cycling through product sizes (default: one per size)",
+            false, 0, "int");
+        TCLAP::ValueArg<size_t> maxInflightBytes("", "max-inflight-bytes",
+            "Store asynchronously, blocking once this many bytes are in flight (0 = synchronous)",
+            false, 0, "bytes");
+        TCLAP::SwitchArg loadById("", "load-by-id",
+            "Also load the products of the next rank directly from their ProductIDs "
+            "(all role, not with --aggregate)", false);
+        TCLAP::ValueArg<size_t> cacheBytes("", "cache-bytes",
+            "Size of the client-side LRU product cache used by the reread role (0 = no cache)",
+            false, 0, "bytes");
+        TCLAP::ValueArg<size_t> reuseDistance("", "reuse-distance",
+            "Number of distinct events read before an event is read again (reread role)",
+            false, 16, "int");
+        TCLAP::ValueArg<unsigned> rereadCount("", "reread-count",
+            "Number of times each event is read (reread role)", false, 2, "int");
+        TCLAP::SwitchArg aggregate("", "aggregate",
+            "Ship products to a per-node aggregator rank that stores and loads them", false);
+        TCLAP::ValueArg<size_t> aggregationBatch("", "aggregation-batch",
+            "Number of events per rank gathered by the aggregator in each round", false, 64, "int");
+        TCLAP::SwitchArg sharedBuffers("", "shared-buffers",
+            "Place generated products and read buffers in a node-level MPI shared-memory window",
+            false);
+        std::vector<std::string> hugePagePolicies = { "none", "transparent", "explicit" };
+        TCLAP::ValuesConstraint<std::string> allowedHugePagePolicies( hugePagePolicies );
+        TCLAP::ValueArg<std::string> hugePages("", "huge-pages",
+            "Back products and read buffers with huge pages (none, transparent, explicit)",
+            false, "none", &allowedHugePagePolicies);
+        std::vector<std::string> drivers = { "threads", "coroutines", "ults" };
+        TCLAP::ValuesConstraint<std::string> allowedDrivers( drivers );
+        TCLAP::ValueArg<std::string> driver("", "driver",
+            "How the pipeline role runs concurrent events (threads, coroutines, ults)", false, "threads",
+            &allowedDrivers);
+        TCLAP::ValueArg<unsigned> concurrency("", "concurrency",
+            "Number of events processed concurrently by the pipeline role", false, 1, "int");
+        TCLAP::ValueArg<unsigned> ioThreads("", "io-threads",
+            "Number of I/O threads (coroutines driver) or xstreams (ults driver, virtual role)",
+            false, 4, "int");
+        TCLAP::ValueArg<unsigned> workers("", "workers",
+            "Number of worker threads resuming coroutines and running their compute kernels "
+            "(coroutines driver)", false, 1, "int");
+        TCLAP::ValueArg<size_t> switchIterations("", "switch-iterations",
+            "Ping-pong iterations used to measure the driver's context switch time (0 = skip)",
+            false, 10000, "int");
+        TCLAP::ValueArg<std::string> exportPrefix("", "export-prefix",
+            "Products are written to <prefix>.<rank>.dat (export role)", false, "export", "prefix");
+        TCLAP::ValueArg<size_t> exportBufferSize("", "export-buffer-size",
+            "Size of the sequential writes to the export files (export role)", false, 64*1024*1024, "int");
+        TCLAP::ValueArg<unsigned> virtualClients("", "virtual-clients",
+            "Maximum number of logical clients emulated per rank as ULTs (virtual role)", false, 64, "int");
+        TCLAP::ValueArg<unsigned> clientInstances("", "client-instances",
+            "Number of DataStore connections per rank, shared round-robin by the --concurrency threads "
+            "(multiclient role)", false, 2, "int");
+        TCLAP::ValueArg<size_t> numDatasets("", "num-datasets",
+            "Number of datasets read per event (correlated role)", false, 2, "int");
+        TCLAP::ValueArg<double> selectionFraction("", "selection-fraction",
+            "Fraction of events whose large product is loaded (skim role)", false, 0.05, "float");
+        TCLAP::ValueArg<size_t> summarySize("", "summary-size",
+            "Size of the small per-event summary product (skim role)", false, 64, "int");
+        TCLAP::ValueArg<size_t> labelCount("", "label-count",
+            "Number of distinct labels stored per event (labels role)", false, 1, "int");
+        TCLAP::ValueArg<size_t> labelLength("", "label-length",
+            "Pad labels to this many characters (labels role)", false, 0, "int");
+        std::vector<std::string> typeNames = { "short", "medium", "long" };
+        TCLAP::ValuesConstraint<std::string> allowedTypeNames( typeNames );
+        TCLAP::ValueArg<std::string> typeName("", "type-name",
+            "Length of the product type name put in keys (labels role: short, medium, long)",
+            false, "short", &allowedTypeNames);
+        TCLAP::ValueArg<std::string> dumpSamples("", "dump-samples",
+            "Write every operation's timing to <prefix>.<rank>.bin (read with hepnos-icarus-samples)",
+            false, "", "prefix");
+        TCLAP::SwitchArg calibrate("", "calibrate",
+            "Measure MPI, memcpy and HEPnOS round-trip performance before the workload", false);
+        TCLAP::ValueArg<std::string> derivedLabel("", "derived-label",
+            "Label of the products stored by the derive role (default: <label>_derived)",
+            false, "", "string");
+        TCLAP::ValueArg<double> derivedRatio("", "derived-ratio",
+            "Size of derived products relative to the loaded ones (derive role)", false, 0.5, "float");
+        std::vector<std::string> storeModes = { "sync", "batch", "async" };
+        TCLAP::ValuesConstraint<std::string> allowedStoreModes( storeModes );
+        TCLAP::ValueArg<std::string> derivedStore("", "derived-store",
+            "How the derive role stores its products (sync, batch, async)", false, "sync",
+            &allowedStoreModes);
+        std::vector<std::string> createPatterns = { "same", "siblings" };
+        TCLAP::ValuesConstraint<std::string> allowedCreatePatterns( createPatterns );
+        TCLAP::ValueArg<std::string> createPattern("", "create-pattern",
+            "Whether ranks of the create role create the same runs or sibling runs (same, siblings)",
+            false, "same", &allowedCreatePatterns);
+        TCLAP::ValueArg<size_t> numRuns("", "num-runs",
+            "Number of runs (each with one subrun) created per pattern (create role)", false, 100, "int");
+        TCLAP::SwitchArg perNodeDetails("", "per-node-details",
+            "Report every node's aggregate metrics, not only their spread", false);
+        std::vector<std::string> skews = { "none", "linear", "zipf" };
+        TCLAP::ValuesConstraint<std::string> allowedSkews( skews );
+        TCLAP::ValueArg<std::string> skew("", "skew",
+            "Vary event counts and product sizes across ranks (none, linear, zipf)", false, "none",
+            &allowedSkews);
+        TCLAP::ValueArg<double> skewFactor("", "skew-factor",
+            "Ratio between the largest and smallest rank (linear) or Zipf exponent (zipf)",
+            false, 2.0, "float");
+        TCLAP::SwitchArg scanPep("", "pep",
+            "Scanner role distributes events dynamically with a ParallelEventProcessor", false);
+        TCLAP::ValueArg<double> spillPeriod("", "spill-period",
+            "Seconds between the start of two beam spills (spill role)", false, 1.0, "float");
+        TCLAP::ValueArg<double> dutyCycle("", "duty-cycle",
+            "Fraction of the spill period during which events arrive (spill role)", false, 0.3, "float");
+        TCLAP::ValueArg<size_t> eventsPerSpill("", "events-per-spill",
+            "Number of events arriving in each spill (spill role)", false, 100, "int");
+        std::vector<std::string> kernels = { "sleep", "deconvolution", "hitfinding", "stream" };
+        TCLAP::ValuesConstraint<std::string> allowedKernels( kernels );
+        TCLAP::ValueArg<std::string> compute("", "compute",
+            "Simulated per-event compute (sleep within --wait-range, deconvolution, hitfinding, stream)",
+            false, "sleep", &allowedKernels);
+        TCLAP::ValueArg<unsigned> computePasses("", "compute-passes",
+            "Number of times the compute kernel runs over each product", false, 1, "int");
+        TCLAP::ValueArg<size_t> computeBytes("", "compute-bytes",
+            "Bytes streamed by the stream kernel (0 = product size)", false, 0, "bytes");
+        TCLAP::SwitchArg noShutdown("", "no-shutdown",
+            "Do not shut down the HEPnOS service when the benchmark completes", false);
 
         cmd.add(protocol);
         cmd.add(margoFile);
@@ -104,6 +474,50 @@ static void parse_arguments(int argc, char** argv) {
         cmd.add(loggingLevel);
         cmd.add(numThreads);
         cmd.add(waitRange);
+        cmd.add(role);
+        cmd.add(noShutdown);
+        cmd.add(calibrate);
+        cmd.add(derivedLabel);
+        cmd.add(derivedRatio);
+        cmd.add(derivedStore);
+        cmd.add(createPattern);
+        cmd.add(numRuns);
+        cmd.add(perNodeDetails);
+        cmd.add(skew);
+        cmd.add(skewFactor);
+        cmd.add(scanPep);
+        cmd.add(spillPeriod);
+        cmd.add(dutyCycle);
+        cmd.add(eventsPerSpill);
+        cmd.add(compute);
+        cmd.add(computePasses);
+        cmd.add(computeBytes);
+        cmd.add(numEvents);
+        cmd.add(maxInflightBytes);
+        cmd.add(loadById);
+        cmd.add(cacheBytes);
+        cmd.add(reuseDistance);
+        cmd.add(rereadCount);
+        cmd.add(aggregate);
+        cmd.add(aggregationBatch);
+        cmd.add(sharedBuffers);
+        cmd.add(hugePages);
+        cmd.add(driver);
+        cmd.add(concurrency);
+        cmd.add(ioThreads);
+        cmd.add(workers);
+        cmd.add(switchIterations);
+        cmd.add(dumpSamples);
+        cmd.add(exportPrefix);
+        cmd.add(exportBufferSize);
+        cmd.add(virtualClients);
+        cmd.add(clientInstances);
+        cmd.add(numDatasets);
+        cmd.add(selectionFraction);
+        cmd.add(summarySize);
+        cmd.add(labelCount);
+        cmd.add(labelLength);
+        cmd.add(typeName);
 
         cmd.parse(argc, argv);
 
@@ -116,6 +530,59 @@ static void parse_arguments(int argc, char** argv) {
         g_logging_level   = spdlog::level::from_str(loggingLevel.getValue());
         g_num_threads     = numThreads.getValue();
         g_wait_range      = parse_wait_range(waitRange.getValue());
+        g_role            = role.getValue();
+        g_no_shutdown     = noShutdown.getValue();
+        g_calibrate       = calibrate.getValue();
+        g_derived_label   = derivedLabel.getValue();
+        g_derived_ratio   = derivedRatio.getValue();
+        g_derived_store   = derivedStore.getValue();
+        g_create_pattern  = createPattern.getValue();
+        g_num_runs        = numRuns.getValue();
+        g_per_node_details = perNodeDetails.getValue();
+        g_skew            = skew.getValue();
+        g_skew_factor     = skewFactor.getValue();
+        g_scan_pep        = scanPep.getValue();
+        g_spill_period    = spillPeriod.getValue();
+        g_duty_cycle      = std::min(std::max(dutyCycle.getValue(), 0.0), 1.0);
+        g_events_per_spill = std::max<size_t>(eventsPerSpill.getValue(), 1);
+        g_compute         = compute.getValue();
+        g_compute_passes  = computePasses.getValue();
+        g_compute_bytes   = computeBytes.getValue();
+        g_num_events      = numEvents.getValue();
+        g_max_inflight_bytes = maxInflightBytes.getValue();
+        g_load_by_id      = loadById.getValue();
+        g_cache_bytes     = cacheBytes.getValue();
+        g_reuse_distance  = std::max<size_t>(reuseDistance.getValue(), 1);
+        g_reread_count    = rereadCount.getValue();
+        g_aggregate       = aggregate.getValue();
+        g_aggregation_batch = std::max<size_t>(aggregationBatch.getValue(), 1);
+        g_shared_buffers  = sharedBuffers.getValue();
+        g_huge_pages      = hugePages.getValue();
+        g_driver          = driver.getValue();
+        g_concurrency     = std::max(concurrency.getValue(), 1u);
+        g_sample_prefix   = dumpSamples.getValue();
+        g_export_prefix   = exportPrefix.getValue();
+        g_export_buffer_size = std::max<size_t>(exportBufferSize.getValue(), 1);
+        g_virtual_clients = std::max(virtualClients.getValue(), 1u);
+        g_client_instances = std::max(clientInstances.getValue(), 1u);
+        g_num_datasets    = std::max<size_t>(numDatasets.getValue(), 1);
+        g_selection_fraction = std::min(std::max(selectionFraction.getValue(), 0.0), 1.0);
+        g_summary_size    = std::max<size_t>(summarySize.getValue(), 1);
+        g_label_count     = std::max<size_t>(labelCount.getValue(), 1);
+        g_label_length    = labelLength.getValue();
+        g_type_name       = typeName.getValue();
+        g_io_threads      = ioThreads.getValue();
+        g_workers         = std::max(workers.getValue(), 1u);
+        g_switch_iterations = switchIterations.getValue();
+        if(g_num_events == 0) g_num_events = g_product_sizes.size();
+        // the ProductIDs are collected by the store phase of the same run
+        if(g_load_by_id && (g_role != "all" || g_aggregate)) {
+            if(g_rank == 0) {
+                spdlog::critical("--load-by-id requires the all role and cannot be used with --aggregate");
+            }
+            MPI_Abort(MPI_COMM_WORLD, -1);
+            exit(-1);
+        }
 
     } catch(TCLAP::ArgException &e) {
         if(g_rank == 0) {
@@ -171,64 +638,1980 @@ static void run_benchmark() {
         spdlog::trace("Creating AsyncEngine with {} threads", g_num_threads);
         hepnos::AsyncEngine async(datastore, g_num_threads);
 
-        hepnos::RunDescriptor run_descriptor;
+        if(g_calibrate) {
+            run_calibration(datastore);
+            g_calibration.done = true;
+        }
 
-        if(g_rank == 0) {
-            spdlog::trace("Creating dataset");
-            auto dataset = datastore.root().createDataSet(g_input_dataset);
-            auto run = dataset.createRun(0);
-            run.toDescriptor(run_descriptor);
-        }
-        MPI_Bcast(&run_descriptor, sizeof(run_descriptor), MPI_BYTE, 0, MPI_COMM_WORLD);
-        auto run = hepnos::Run::fromDescriptor(datastore, run_descriptor, false);
-        auto subrun = run.createSubRun(g_rank);
-
-        // create dummy products
-        std::vector<dummy_product> products;
-        products.resize(g_product_sizes.size());
+        auto products = create_products();
+        std::vector<hepnos::ProductID> product_ids;
+
+        if(g_role == "all" || g_role == "writer") {
+            auto run = open_run(datastore, true);
+            if(g_aggregate)
+                run_aggregated_store_phase(datastore, run, products);
+            else if(g_max_inflight_bytes)
+                run_bounded_store_phase(async, run, products, product_ids);
+            else
+                run_store_phase(run, products, product_ids);
+        }
+        if(g_role == "all" || g_role == "reader") {
+            auto run = open_run(datastore, false);
+            if(g_aggregate)
+                run_aggregated_load_phase(run, products);
+            else
+                run_load_phase(run, products);
+        }
+        if(g_load_by_id) {
+            run_load_by_id_phase(datastore, products, product_ids);
+        }
+        if(g_role == "scanner") {
+            if(g_scan_pep)
+                run_pep_scan_phase(datastore, async);
+            else
+                run_scan_phase(datastore);
+        }
+        if(g_role == "lookup") {
+            auto run = open_run(datastore, false);
+            run_lookup_phase(datastore, run);
+        }
+        if(g_role == "pipeline") {
+            auto run = open_run(datastore, true);
+            run_pipeline_phase(run, products);
+        }
+        if(g_role == "spill") {
+            auto run = open_run(datastore, true);
+            run_spill_phase(run, products);
+        }
+        if(g_role == "hot") {
+            auto run = open_run(datastore, true);
+            run_hot_phase(datastore, run, products);
+        }
+        if(g_role == "labels") {
+            auto run = open_run(datastore, true);
+            run_labels_phase(run, products);
+        }
+        if(g_role == "skim") {
+            auto run = open_run(datastore, true);
+            run_skim_phase(datastore, async, run, products);
+        }
+        if(g_role == "export") {
+            run_export_phase(datastore);
+        }
+        if(g_role == "virtual") {
+            auto run = open_run(datastore, true);
+            run_virtual_phase(run, products);
+        }
+        if(g_role == "multiclient") {
+            run_multiclient_phase(datastore, products);
+        }
+        if(g_role == "correlated") {
+            run_correlated_phase(datastore, products);
+        }
+        if(g_role == "create") {
+            run_create_phase(datastore);
+        }
+        if(g_role == "derive") {
+            auto run = open_run(datastore, false);
+            run_derive_phase(datastore, async, run);
+        }
+        if(g_role == "reread") {
+            auto run = open_run(datastore, false);
+            double baseline = run_reread_phase(run, nullptr);
+            if(g_cache_bytes) {
+                LRUProductCache cache(g_cache_bytes);
+                double cached = run_reread_phase(run, &cache);
+                if(g_rank == 0 && baseline > 0.0)
+                    spdlog::info("cache throughput gain={:.3f}", cached / baseline);
+            }
+        }
+    }
+
+    report_memory();
+    if(g_products_win != MPI_WIN_NULL) MPI_Win_free(&g_products_win);
+    if(g_read_win != MPI_WIN_NULL) MPI_Win_free(&g_read_win);
+    g_products_buffer.reset();
+    g_read_huge_buffer.reset();
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(g_rank == 0 && !g_no_shutdown) {
+        datastore.shutdown();
+    }
+}
+
+static hepnos::Run open_run(hepnos::DataStore& datastore, bool create, const std::string& dataset_name) {
+    hepnos::RunDescriptor run_descriptor;
+
+    if(g_rank == 0) {
+        try {
+            if(create) {
+                spdlog::trace("Creating dataset {}", dataset_name);
+                auto dataset = datastore.root().createDataSet(dataset_name);
+                auto run = dataset.createRun(0);
+                run.toDescriptor(run_descriptor);
+            } else {
+                spdlog::trace("Opening dataset {}", dataset_name);
+                auto dataset = datastore.root()[dataset_name];
+                auto run = dataset.runs()[0];
+                run.toDescriptor(run_descriptor);
+            }
+        } catch(const hepnos::Exception& ex) {
+            spdlog::critical("Could not open dataset {}: {}", dataset_name, ex.what());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Bcast(&run_descriptor, sizeof(run_descriptor), MPI_BYTE, 0, MPI_COMM_WORLD);
+    return hepnos::Run::fromDescriptor(datastore, run_descriptor, false);
+}
+
+static hepnos::DataSet open_dataset(hepnos::DataStore& datastore, const std::string& dataset_name) {
+    hepnos::DataSet dataset;
+    try {
+        spdlog::trace("Opening dataset {}", dataset_name);
+        dataset = datastore.root()[dataset_name];
+    } catch(const hepnos::Exception& ex) {
+        spdlog::critical("Could not open dataset {}: {}", dataset_name, ex.what());
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return dataset;
+}
+
+static std::vector<dummy_product> create_products() {
+    std::vector<dummy_product> products;
+    products.resize(g_product_sizes.size());
+    size_t total_size = 0, max_size = 0;
+    for(auto size : g_product_sizes) {
+        total_size += size;
+        max_size = std::max(max_size, size);
+    }
+    if(g_shared_buffers && g_huge_pages != "none" && g_rank == 0) {
+        spdlog::warn("--huge-pages is ignored when --shared-buffers is used");
+    }
+
+    if(!g_shared_buffers && g_huge_pages != "none") {
+        long faults = get_page_faults();
+        double t_start = MPI_Wtime();
+        g_products_buffer.reset(new HugePageBuffer(total_size, g_huge_pages));
+        g_read_huge_buffer.reset(new HugePageBuffer(max_size, g_huge_pages));
+        if(!g_products_buffer->data() || !g_read_huge_buffer->data()) {
+            spdlog::critical("Could not allocate product buffers");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        size_t offset = 0;
+        for(size_t i = 0; i < products.size(); i++) {
+            products[i].external_data     = g_products_buffer->data() + offset;
+            products[i].external_size     = g_product_sizes[i];
+            products[i].external_capacity = g_product_sizes[i];
+            for(size_t j = 0; j < g_product_sizes[i]; j++)
+                products[i].external_data[j] = j % 256;
+            offset += g_product_sizes[i];
+        }
+        g_read_buffer      = g_read_huge_buffer->data();
+        g_read_buffer_size = max_size;
+        double fill_time = MPI_Wtime() - t_start;
+        g_last_page_faults = get_page_faults();
+        spdlog::info("product buffers backed by {} pages, fill took {} seconds with {} page faults",
+                     g_products_buffer->backing(), fill_time, g_last_page_faults - faults);
+        return products;
+    }
+
+    if(!g_shared_buffers) {
         for(size_t i = 0; i < products.size(); i++) {
             products[i].data.resize(g_product_sizes[i]);
             for(size_t j = 0; j < g_product_sizes[i]; j++)
                 products[i].data[j] = j % 256;
         }
+        return products;
+    }
 
-        MPI_Barrier(MPI_COMM_WORLD);
+    // the first rank of each node holds the payloads, other ranks map them
+    char* base = nullptr;
+    MPI_Aint local_size = g_node_rank == 0 ? total_size : 0;
+    MPI_Win_allocate_shared(local_size, 1, MPI_INFO_NULL, g_node_comm, &base, &g_products_win);
+    MPI_Aint segment_size;
+    int disp_unit;
+    MPI_Win_shared_query(g_products_win, 0, &segment_size, &disp_unit, &base);
 
-        hepnos::EventNumber evn = 0;
-        for(const auto& product : products) {
+    MPI_Win_fence(0, g_products_win);
+    size_t offset = 0;
+    for(size_t i = 0; i < products.size(); i++) {
+        products[i].external_data     = base + offset;
+        products[i].external_size     = g_product_sizes[i];
+        products[i].external_capacity = g_product_sizes[i];
+        if(g_node_rank == 0) {
+            for(size_t j = 0; j < g_product_sizes[i]; j++)
+                products[i].external_data[j] = j % 256;
+        }
+        offset += g_product_sizes[i];
+    }
+    MPI_Win_fence(0, g_products_win);
+
+    // each rank gets its own read buffer in the node's shared segment
+    MPI_Win_allocate_shared(max_size, 1, MPI_INFO_NULL, g_node_comm, &g_read_buffer, &g_read_win);
+    g_read_buffer_size = max_size;
+
+    if(g_rank == 0) {
+        spdlog::info("payload bytes per node: private={} shared={}",
+                     total_size * g_node_size, total_size);
+    }
+    return products;
+}
+
+static void attach_read_buffer(dummy_product& product) {
+    if(!g_read_buffer) return;
+    product.external_data     = g_read_buffer;
+    product.external_capacity = g_read_buffer_size;
+}
+
+static void report_memory() {
+    // RSS counts shared window pages once per rank mapping them, PSS splits
+    // them among those ranks, so the node's PSS shows what sharing saves
+    long local_values[2] = { get_max_rss_kb(), get_pss_kb() };
+    long node_values[2] = { 0, 0 }, max_node_values[2] = { 0, 0 };
+    MPI_Allreduce(local_values, node_values, 2, MPI_LONG, MPI_SUM, g_node_comm);
+    MPI_Reduce(node_values, max_node_values, 2, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(g_rank == 0) {
+        spdlog::info("memory max_node_rss_kb={} max_node_pss_kb={} (RSS: sum of per-rank peaks, "
+                     "PSS: current, shared pages counted once per node)",
+                     max_node_values[0], max_node_values[1]);
+    }
+}
+
+static void run_store_phase(hepnos::Run& run, const std::vector<dummy_product>& products,
+                            std::vector<hepnos::ProductID>& product_ids) {
+    auto subrun = run.createSubRun(g_rank);
+    product_ids.reserve(g_num_events);
+
+    measure_phase("store", op_store, [&](phase_stats& phase) {
+        for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+            const auto& product = products[evn % products.size()];
+            double t1 = MPI_Wtime();
             auto event = subrun.createEvent(evn);
             hepnos::StoreStatistics stats;
-            event.store(g_product_label, product, &stats);
-            spdlog::info("size={}, storage={}, serialization={}", product.data.size(),
+            product_ids.push_back(event.store(g_product_label, product, &stats));
+            phase.add(product.size(), MPI_Wtime() - t1,
+                      stats.raw_storage_time.max, stats.serialization_time.max);
+            spdlog::info("size={}, storage={}, serialization={}", product.size(),
                          stats.raw_storage_time.max, stats.serialization_time.max);
-            evn += 1;
         }
+    });
+}
 
-        MPI_Barrier(MPI_COMM_WORLD);
-        evn = 0;
+static void run_bounded_store_phase(hepnos::AsyncEngine& async, hepnos::Run& run,
+                                    const std::vector<dummy_product>& products,
+                                    std::vector<hepnos::ProductID>& product_ids) {
+    auto subrun = run.createSubRun(g_rank);
+    product_ids.reserve(g_num_events);
+    // The AsyncEngine does not report individual completions, so once the
+    // limit would be exceeded the producer blocks until everything drained.
+    size_t inflight_bytes = 0;
+    size_t peak_inflight_bytes = 0;
+    double blocked_time = 0.0;
+    reset_peak_rss();
+
+    // latencies only cover handing the store to the AsyncEngine, completion
+    // is not observable per operation, hence the distinct phase name
+    measure_phase("store_enqueue", op_store, [&](phase_stats& phase) {
+        {
+            hepnos::WriteBatch batch(async);
+            for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+                const auto& product = products[evn % products.size()];
+                size_t size = product.size();
+                if(inflight_bytes != 0 && inflight_bytes + size > g_max_inflight_bytes) {
+                    double t_block = MPI_Wtime();
+                    batch.flush();
+                    async.wait();
+                    blocked_time += MPI_Wtime() - t_block;
+                    inflight_bytes = 0;
+                }
+                double t1 = MPI_Wtime();
+                auto event = subrun.createEvent(batch, evn);
+                product_ids.push_back(event.store(batch, g_product_label, product));
+                phase.add(size, MPI_Wtime() - t1);
+                inflight_bytes += size;
+                peak_inflight_bytes = std::max(peak_inflight_bytes, inflight_bytes);
+            }
+            batch.flush();
+        }
+        async.wait();
+    });
+    for(const auto& error : async.errors()) {
+        spdlog::error("AsyncEngine error: {}", error);
+    }
+
+    unsigned long local_peak = peak_inflight_bytes, max_peak = 0;
+    long local_rss = get_peak_rss_kb(), max_rss = 0;
+    double max_blocked = 0.0;
+    MPI_Reduce(&local_peak, &max_peak, 1, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&local_rss, &max_rss, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&blocked_time, &max_blocked, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(g_rank == 0) {
+        spdlog::info("inflight limit={} peak_inflight={} blocked_time={:.6f} phase_peak_rss_kb={}",
+                     g_max_inflight_bytes, max_peak, max_blocked, max_rss);
+    }
+}
+
+static void run_load_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    auto subrun = run[g_rank];
 
-        std::vector<dummy_product> loaded_products;
-        for(const auto& product : products) {
+    measure_phase("load", op_load, [&](phase_stats& phase) {
+        for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+            const auto& product = products[evn % products.size()];
+            double t1 = MPI_Wtime();
             auto event = subrun[evn];
             dummy_product tmp_product;
+            attach_read_buffer(tmp_product);
             hepnos::LoadStatistics stats;
             event.load(g_product_label, tmp_product, &stats);
-            if(tmp_product.data != product.data) {
+            phase.add(tmp_product.size(), MPI_Wtime() - t1,
+                      stats.raw_loading_time.max, stats.deserialization_time.max);
+            if(tmp_product != product) {
                 spdlog::error("Loaded product doesn't match stored product!");
             }
-            spdlog::info("size={}, loading={}, deserialization={}", product.data.size(),
+            spdlog::info("size={}, loading={}, deserialization={}", product.size(),
                          stats.raw_loading_time.max, stats.deserialization_time.max);
-            evn += 1;
         }
+    });
+}
+
+static size_t packed_size(hepnos::EventNumber first, hepnos::EventNumber last) {
+    size_t size = 0;
+    for(hepnos::EventNumber evn = first; evn < last; evn++)
+        size += g_product_sizes[evn % g_product_sizes.size()];
+    return size;
+}
 
+/**
+ * Per-rank byte count of a batch, as used in MPI_Gather/MPI_Scatter.
+ * Every rank stores the same sizes, so all ranks abort together.
+ */
+static int packed_count(hepnos::EventNumber first, hepnos::EventNumber last) {
+    size_t size = packed_size(first, last);
+    if(size > (size_t)INT_MAX) {
+        spdlog::critical("A batch of {} events packs {} bytes per rank, more than MPI can count ({}), "
+                         "reduce --aggregation-batch", last - first, size, INT_MAX);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    return (int)size;
+}
 
-    MPI_Barrier(MPI_COMM_WORLD);
+static void run_aggregated_store_phase(hepnos::DataStore& datastore, hepnos::Run& run,
+                                       const std::vector<dummy_product>& products) {
+    bool is_aggregator = g_node_rank == 0;
+    std::vector<int> members(g_node_size);
+    MPI_Gather(&g_rank, 1, MPI_INT, members.data(), 1, MPI_INT, 0, g_node_comm);
+    std::vector<hepnos::SubRun> subruns;
+    if(is_aggregator) {
+        for(int member : members)
+            subruns.push_back(run.createSubRun(member));
+    }
+
+    measure_phase("aggregated_store", op_store, [&](phase_stats& phase) {
+        std::unique_ptr<hepnos::WriteBatch> batch;
+        if(is_aggregator)
+            batch.reset(new hepnos::WriteBatch(datastore, g_aggregation_batch * g_node_size));
+        for(hepnos::EventNumber first = 0; first < g_num_events; first += g_aggregation_batch) {
+            double t1 = MPI_Wtime();
+            hepnos::EventNumber last = std::min<hepnos::EventNumber>(first + g_aggregation_batch, g_num_events);
+            // every rank stores the same product sizes, so offsets are known everywhere
+            int member_size = packed_count(first, last);
+            std::string send_buffer;
+            send_buffer.reserve(member_size);
+            for(hepnos::EventNumber evn = first; evn < last; evn++) {
+                const auto& product = products[evn % products.size()];
+                send_buffer.append(product.payload(), product.size());
+            }
+            std::string recv_buffer;
+            if(is_aggregator) recv_buffer.resize((size_t)member_size * g_node_size);
+            MPI_Gather(&send_buffer[0], member_size, MPI_BYTE,
+                       &recv_buffer[0], member_size, MPI_BYTE, 0, g_node_comm);
+            if(!is_aggregator) continue;
+            size_t offset = 0;
+            dummy_product tmp_product;
+            for(auto& subrun : subruns) {
+                for(hepnos::EventNumber evn = first; evn < last; evn++) {
+                    size_t size = g_product_sizes[evn % g_product_sizes.size()];
+                    tmp_product.data.assign(recv_buffer, offset, size);
+                    offset += size;
+                    auto event = subrun.createEvent(*batch, evn);
+                    event.store(*batch, g_product_label, tmp_product);
+                }
+            }
+            double latency = (MPI_Wtime() - t1) / ((last - first) * g_node_size);
+            for(size_t i = 0; i < subruns.size(); i++)
+                for(hepnos::EventNumber evn = first; evn < last; evn++)
+                    phase.add(g_product_sizes[evn % g_product_sizes.size()], latency);
+        }
+    });
+}
+
+static void run_aggregated_load_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    bool is_aggregator = g_node_rank == 0;
+    std::vector<int> members(g_node_size);
+    MPI_Gather(&g_rank, 1, MPI_INT, members.data(), 1, MPI_INT, 0, g_node_comm);
+    std::vector<hepnos::SubRun> subruns;
+    if(is_aggregator) {
+        for(int member : members)
+            subruns.push_back(run[member]);
+    }
+
+    measure_phase("aggregated_load", op_load, [&](phase_stats& phase) {
+        for(hepnos::EventNumber first = 0; first < g_num_events; first += g_aggregation_batch) {
+            double t1 = MPI_Wtime();
+            hepnos::EventNumber last = std::min<hepnos::EventNumber>(first + g_aggregation_batch, g_num_events);
+            int member_size = packed_count(first, last);
+            std::string send_buffer;
+            if(is_aggregator) {
+                send_buffer.reserve((size_t)member_size * g_node_size);
+                for(auto& subrun : subruns) {
+                    for(hepnos::EventNumber evn = first; evn < last; evn++) {
+                        dummy_product tmp_product;
+                        attach_read_buffer(tmp_product);
+                        subrun[evn].load(g_product_label, tmp_product);
+                        send_buffer.append(tmp_product.payload(), tmp_product.size());
+                    }
+                }
+                if(send_buffer.size() != (size_t)member_size * g_node_size) {
+                    spdlog::error("Aggregator loaded {} bytes, expected {}",
+                                  send_buffer.size(), (size_t)member_size * g_node_size);
+                    send_buffer.resize((size_t)member_size * g_node_size);
+                }
+            }
+            std::string recv_buffer(member_size, '\0');
+            MPI_Scatter(&send_buffer[0], member_size, MPI_BYTE,
+                        &recv_buffer[0], member_size, MPI_BYTE, 0, g_node_comm);
+            double latency = (MPI_Wtime() - t1) / (last - first);
+            size_t offset = 0;
+            for(hepnos::EventNumber evn = first; evn < last; evn++) {
+                const auto& product = products[evn % products.size()];
+                if(recv_buffer.compare(offset, product.size(), product.payload(), product.size()) != 0) {
+                    spdlog::error("Loaded product doesn't match stored product!");
+                }
+                offset += product.size();
+                phase.add(product.size(), latency);
+            }
+        }
+    });
+}
+
+static void run_load_by_id_phase(hepnos::DataStore& datastore,
+                                 const std::vector<dummy_product>& products,
+                                 const std::vector<hepnos::ProductID>& product_ids) {
+    // load the products stored by the previous rank, so IDs cross process boundaries
+    auto remote_ids = exchange_product_ids(product_ids);
+
+    measure_phase("load_by_id", op_load, [&](phase_stats& phase) {
+        for(size_t i = 0; i < remote_ids.size(); i++) {
+            const auto& product = products[i % products.size()];
+            double t1 = MPI_Wtime();
+            dummy_product tmp_product;
+            attach_read_buffer(tmp_product);
+            if(!datastore.loadProduct(remote_ids[i], tmp_product)) {
+                spdlog::error("Could not load product from its ProductID");
+                continue;
+            }
+            phase.add(tmp_product.size(), MPI_Wtime() - t1);
+            if(tmp_product != product) {
+                spdlog::error("Loaded product doesn't match stored product!");
+            }
+        }
+    });
+}
+
+static std::vector<hepnos::ProductID> exchange_product_ids(const std::vector<hepnos::ProductID>& ids) {
+    std::string send_buffer;
+    {
+        std::stringstream ss;
+        boost::archive::binary_oarchive oa(ss);
+        oa << ids;
+        send_buffer = ss.str();
+    }
+    int dest   = (g_rank + 1) % g_size;
+    int source = (g_rank + g_size - 1) % g_size;
+    unsigned long send_size = send_buffer.size(), recv_size = 0;
+    MPI_Sendrecv(&send_size, 1, MPI_UNSIGNED_LONG, dest, 0,
+                 &recv_size, 1, MPI_UNSIGNED_LONG, source, 0,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    std::string recv_buffer(recv_size, '\0');
+    MPI_Sendrecv(&send_buffer[0], send_size, MPI_BYTE, dest, 1,
+                 &recv_buffer[0], recv_size, MPI_BYTE, source, 1,
+                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    std::vector<hepnos::ProductID> result;
+    std::stringstream ss(recv_buffer);
+    boost::archive::binary_iarchive ia(ss);
+    ia >> result;
+    return result;
+}
+
+static void run_scan_phase(hepnos::DataStore& datastore) {
+    auto dataset = open_dataset(datastore);
+
+    measure_phase("scan", op_load, [&](phase_stats& phase) {
+        // subruns are distributed round-robin across ranks
+        for(auto& run : dataset.runs()) {
+            for(auto& subrun : run) {
+                if(subrun.number() % g_size != (unsigned)g_rank) continue;
+                for(auto& event : subrun) {
+                    double t1 = MPI_Wtime();
+                    dummy_product tmp_product;
+                    hepnos::LoadStatistics stats;
+                    if(!event.load(g_product_label, tmp_product, &stats)) continue;
+                    simulate_compute(tmp_product, g_mte);
+                    phase.add(tmp_product.size(), MPI_Wtime() - t1,
+                              stats.raw_loading_time.max, stats.deserialization_time.max);
+                    spdlog::debug("scanned run={}, subrun={}, event={}, size={}",
+                                  run.number(), subrun.number(), event.number(),
+                                  tmp_product.size());
+                }
+            }
+        }
+    });
+}
+
+static void run_pep_scan_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async) {
+    auto dataset = open_dataset(datastore);
+    std::mutex phase_mutex;
+
+    measure_phase("scan_pep", op_load, [&](phase_stats& phase) {
+        // events are handed out dynamically across ranks
+        hepnos::ParallelEventProcessor pep(async, MPI_COMM_WORLD);
+        pep.preload<dummy_product>(g_product_label);
+        pep.process(dataset, [&](const hepnos::Event& event, const hepnos::ProductCache& cache) {
+            double t1 = MPI_Wtime();
+            dummy_product tmp_product;
+            if(!event.load(cache, g_product_label, tmp_product)) return;
+            if(g_compute == "sleep") {
+                double wait;
+                {
+                    std::lock_guard<std::mutex> lock(phase_mutex);
+                    wait = draw_wait_time(g_mte);
+                }
+                std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            } else {
+                run_compute_kernel(tmp_product);
+            }
+            std::lock_guard<std::mutex> lock(phase_mutex);
+            phase.add(tmp_product.size(), MPI_Wtime() - t1);
+        });
+    });
+}
+
+static void run_export_phase(hepnos::DataStore& datastore) {
+    auto dataset = open_dataset(datastore);
+    std::string filename = g_export_prefix + "." + std::to_string(g_rank) + ".dat";
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    if(!ofs.good()) {
+        spdlog::critical("Could not open {} for writing", filename);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // records are (run, subrun, event, size) as u64 followed by the payload,
+    // accumulated so the file only sees large sequential writes
+    std::string buffer;
+    buffer.reserve(g_export_buffer_size);
+    double write_time = 0.0;
+    size_t num_writes = 0, bytes_written = 0;
+    auto flush = [&]() {
+        if(buffer.empty()) return;
+        double t1 = MPI_Wtime();
+        ofs.write(buffer.data(), buffer.size());
+        write_time += MPI_Wtime() - t1;
+        num_writes += 1;
+        bytes_written += buffer.size();
+        buffer.clear();
+    };
+
+    measure_phase("export", op_load, [&](phase_stats& phase) {
+        {
+            hepnos::Prefetcher prefetcher(datastore);
+            prefetcher.fetchProduct<std::string, dummy_product>(g_product_label);
+            // subruns of all runs are distributed round-robin across ranks
+            size_t subrun_index = 0;
+            for(auto& run : dataset.runs()) {
+                for(auto& subrun : run) {
+                    if(subrun_index++ % g_size != (size_t)g_rank) continue;
+                    for(auto it = subrun.begin(prefetcher); it != subrun.end(); ++it) {
+                        double t1 = MPI_Wtime();
+                        dummy_product product;
+                        if(!it->load(prefetcher, g_product_label, product)) continue;
+                        uint64_t header[4] = { run.number(), subrun.number(), it->number(), product.size() };
+                        if(buffer.size() + sizeof(header) + product.size() > g_export_buffer_size) flush();
+                        buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+                        buffer.append(product.payload(), product.size());
+                        phase.add(product.size(), MPI_Wtime() - t1);
+                    }
+                }
+            }
+        }
+        flush();
+        ofs.close();
+        if(ofs.fail()) spdlog::error("Error while writing {}", filename);
+    });
+
+    unsigned long local_counts[2] = { num_writes, bytes_written }, total_counts[2] = { 0, 0 };
+    double max_write_time = 0.0;
+    MPI_Reduce(local_counts, total_counts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&write_time, &max_write_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     if(g_rank == 0) {
-        datastore.shutdown();
+        spdlog::info("export files={}.*.dat writes={} bytes_written={} write_time_max={:.6f}",
+                     g_export_prefix, total_counts[0], total_counts[1], max_write_time);
+    }
+}
+
+static void run_lookup_phase(hepnos::DataStore& datastore, hepnos::Run& run) {
+    auto subrun = run[g_rank];
+
+    measure_events("lookup_hit", op_lookup, [&subrun](hepnos::EventNumber evn) {
+        if(!subrun[evn].valid())
+            spdlog::error("Event {} should exist", evn);
+        return (size_t)0;
+    });
+    measure_events("lookup_miss", op_lookup, [&subrun](hepnos::EventNumber evn) {
+        if(subrun.find(evn + g_num_events) != subrun.end())
+            spdlog::error("Event {} should not exist", evn + g_num_events);
+        return (size_t)0;
+    });
+    measure_events("find_hit", op_lookup, [&subrun](hepnos::EventNumber evn) {
+        if(subrun.find(evn) == subrun.end())
+            spdlog::error("Event {} should exist", evn);
+        return (size_t)0;
+    });
+    measure_events("iterator_begin", op_lookup, [&subrun](hepnos::EventNumber) {
+        if(subrun.begin() == subrun.end())
+            spdlog::error("SubRun {} should not be empty", subrun.number());
+        return (size_t)0;
+    });
+
+    // lookup followed by a load, which is the path our readers take today
+    measure_events("lookup_load", op_load, [&subrun](hepnos::EventNumber evn) {
+        dummy_product tmp_product;
+        subrun[evn].load(g_product_label, tmp_product);
+        return tmp_product.size();
+    });
+
+    // cached handles: descriptors rebuilt into events without validation
+    std::vector<hepnos::EventDescriptor> descriptors(g_num_events);
+    for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++)
+        subrun[evn].toDescriptor(descriptors[evn]);
+    measure_events("handle_load", op_load, [&datastore, &descriptors](hepnos::EventNumber evn) {
+        dummy_product tmp_product;
+        auto event = hepnos::Event::fromDescriptor(datastore, descriptors[evn], false);
+        event.load(g_product_label, tmp_product);
+        return tmp_product.size();
+    });
+
+    // batched: iterating with a prefetcher lists events and products in batches
+    measure_phase("prefetch_iterate", op_load, [&](phase_stats& phase) {
+        hepnos::Prefetcher prefetcher(datastore);
+        prefetcher.fetchProduct<std::string, dummy_product>(g_product_label);
+        double t1 = MPI_Wtime();
+        for(auto it = subrun.begin(prefetcher); it != subrun.end(); ++it) {
+            dummy_product tmp_product;
+            it->load(prefetcher, g_product_label, tmp_product);
+            double t2 = MPI_Wtime();
+            phase.add(tmp_product.size(), t2 - t1);
+            t1 = t2;
+        }
+    });
+}
+
+static double run_reread_phase(hepnos::Run& run, LRUProductCache* cache) {
+    auto subrun = run[g_rank];
+
+    double ops_per_sec = measure_phase(cache ? "reread_cache" : "reread_nocache", op_load,
+                                       [&](phase_stats& phase) {
+        // events are read in blocks of g_reuse_distance, each block g_reread_count times
+        for(hepnos::EventNumber first = 0; first < g_num_events; first += g_reuse_distance) {
+            hepnos::EventNumber last = std::min<hepnos::EventNumber>(first + g_reuse_distance, g_num_events);
+            for(unsigned pass = 0; pass < g_reread_count; pass++) {
+                for(hepnos::EventNumber evn = first; evn < last; evn++) {
+                    double t1 = MPI_Wtime();
+                    dummy_product tmp_product;
+                    auto key = std::make_tuple(subrun.number(), evn, g_product_label);
+                    if(!cache || !cache->get(key, tmp_product)) {
+                        subrun[evn].load(g_product_label, tmp_product);
+                        if(cache) cache->put(key, tmp_product);
+                    }
+                    phase.add(tmp_product.size(), MPI_Wtime() - t1);
+                }
+            }
+        }
+    });
+
+    if(!cache) return ops_per_sec;
+    unsigned long local_counts[3] = { cache->hits(), cache->misses(), cache->evictions() };
+    unsigned long total_counts[3] = { 0, 0, 0 };
+    unsigned long local_peak = cache->peak_bytes(), max_peak = 0;
+    long local_rss = get_max_rss_kb(), max_rss = 0;
+    MPI_Reduce(local_counts, total_counts, 3, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&local_peak, &max_peak, 1, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&local_rss, &max_rss, 1, MPI_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(g_rank == 0) {
+        unsigned long accesses = total_counts[0] + total_counts[1];
+        spdlog::info("cache capacity={} hits={} misses={} evictions={} hit_rate={:.3f} "
+                     "peak_cache_bytes={} max_rss_kb={}",
+                     g_cache_bytes, total_counts[0], total_counts[1], total_counts[2],
+                     accesses ? (double)total_counts[0]/accesses : 0.0, max_peak, max_rss);
+    }
+    return ops_per_sec;
+}
+
+static double draw_wait_time(std::mt19937& mte) {
+    std::uniform_real_distribution<double> dist(g_wait_range.first, g_wait_range.second);
+    return dist(mte);
+}
+
+static void run_compute_kernel(const dummy_product& product) {
+    // compute never yields, so a thread_local is never shared between concurrent ULTs
+    thread_local compute_kernels::stream_scratch scratch;
+    double checksum = 0.0;
+    for(unsigned pass = 0; pass < g_compute_passes; pass++) {
+        if(g_compute == "deconvolution")
+            checksum += compute_kernels::deconvolution(product.payload(), product.size());
+        else if(g_compute == "hitfinding")
+            checksum += compute_kernels::hit_finding(product.payload(), product.size());
+        else if(g_compute == "stream")
+            checksum += compute_kernels::stream(product.payload(), product.size(),
+                                                g_compute_bytes ? g_compute_bytes : product.size(),
+                                                scratch);
+    }
+    volatile double sink = checksum;
+    (void)sink;
+}
+
+static void simulate_compute(const dummy_product& product, std::mt19937& mte) {
+    if(g_compute == "sleep")
+        std::this_thread::sleep_for(std::chrono::duration<double>(draw_wait_time(mte)));
+    else
+        run_compute_kernel(product);
+}
+
+static void run_pipeline_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    auto subrun = run.createSubRun(g_rank);
+    std::vector<phase_stats> lane_stats(g_concurrency);
+    for(auto& lane : lane_stats) lane.op = op_process;
+    std::atomic<hepnos::EventNumber> next_event(0);
+
+    if(g_switch_iterations && g_driver != "coroutines") {
+        report_switch_time();
+    }
+
+    measure_phase("pipeline_" + g_driver, op_process, [&](phase_stats& phase) {
+        if(g_driver == "threads") {
+            run_threads_driver(subrun, products, next_event, lane_stats);
+        }
+        else if(g_driver == "ults") {
+            run_ults_driver(subrun, products, next_event, lane_stats);
+        }
+#ifdef HEPNOS_BENCHMARK_COROUTINES
+        else if(g_driver == "coroutines") {
+            CoroutineScheduler sched(g_workers, g_io_threads);
+            for(unsigned i = 0; i < g_concurrency; i++)
+                sched.spawn(pipeline_coroutine(sched, subrun, products, next_event,
+                                               lane_stats[i], g_rank * g_concurrency + i));
+            sched.wait();
+        }
+#endif
+        else {
+            spdlog::critical("Driver {} is not available in this build", g_driver);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        for(const auto& lane : lane_stats) {
+            phase.merge(lane);
+        }
+    });
+}
+
+/**
+ * Stores product in event evn of subrun, loads it back into tmp_product
+ * and checks that both match.
+ */
+static void store_and_load_back(const hepnos::SubRun& subrun, hepnos::EventNumber evn,
+                                const dummy_product& product, dummy_product& tmp_product) {
+    subrun.createEvent(evn).store(g_product_label, product);
+    subrun[evn].load(g_product_label, tmp_product);
+    if(tmp_product != product) {
+        spdlog::error("Loaded product doesn't match stored product!");
     }
 }
 
+static void run_threads_driver(const hepnos::SubRun& subrun,
+                               const std::vector<dummy_product>& products,
+                               std::atomic<hepnos::EventNumber>& next_event,
+                               std::vector<phase_stats>& lane_stats) {
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < g_concurrency; i++) {
+        threads.emplace_back([&, i]() {
+            std::mt19937 mte(g_rank * g_concurrency + i);
+            hepnos::EventNumber evn;
+            while((evn = next_event++) < g_num_events) {
+                const auto& product = products[evn % products.size()];
+                double t1 = MPI_Wtime();
+                dummy_product tmp_product;
+                store_and_load_back(subrun, evn, product, tmp_product);
+                simulate_compute(tmp_product, mte);
+                lane_stats[i].add(product.size(), MPI_Wtime() - t1);
+            }
+        });
+    }
+    for(auto& t : threads) t.join();
+}
+
+/**
+ * Wakes sleeping ULTs up from a plain thread. A sleeping ULT waits on an
+ * eventual, so it is off its pool and costs no CPU, unlike a yield loop.
+ */
+class ult_timer {
+
+    typedef std::chrono::steady_clock clock;
+
+    std::mutex                                  m_mutex;
+    std::condition_variable                     m_cv;
+    std::multimap<clock::time_point, ABT_eventual> m_deadlines;
+    bool                                        m_stop = false;
+    std::thread                                 m_thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while(!m_stop) {
+            if(m_deadlines.empty()) {
+                m_cv.wait(lock);
+                continue;
+            }
+            auto first = m_deadlines.begin();
+            if(first->first <= clock::now()) {
+                ABT_eventual_set(first->second, nullptr, 0);
+                m_deadlines.erase(first);
+            } else {
+                m_cv.wait_until(lock, first->first);
+            }
+        }
+    }
+
+    public:
+
+    ult_timer()
+    : m_thread([this]() { run(); }) {}
+
+    ~ult_timer() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    void sleep_for(double seconds) {
+        if(seconds <= 0.0) return;
+        ABT_eventual eventual;
+        ABT_eventual_create(0, &eventual);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_deadlines.emplace(clock::now() + std::chrono::duration_cast<clock::duration>(
+                                    std::chrono::duration<double>(seconds)), eventual);
+        }
+        m_cv.notify_one();
+        ABT_eventual_wait(eventual, nullptr);
+        ABT_eventual_free(&eventual);
+    }
+};
+
+struct ult_lane_args {
+    ult_timer*                        timer;
+    const hepnos::SubRun*             subrun;
+    const std::vector<dummy_product>* products;
+    std::atomic<hepnos::EventNumber>* next_event;
+    phase_stats*                      stats;
+    unsigned                          seed;
+};
+
+static void pipeline_ult(void* arg) {
+    auto args = static_cast<ult_lane_args*>(arg);
+    std::mt19937 mte(args->seed);
+    hepnos::EventNumber evn;
+    while((evn = (*args->next_event)++) < g_num_events) {
+        const auto& product = (*args->products)[evn % args->products->size()];
+        double t1 = MPI_Wtime();
+        dummy_product tmp_product;
+        // HEPnOS calls made from a ULT block on Argobots eventuals,
+        // letting the xstream run other ULTs while the RPC is in flight
+        store_and_load_back(*args->subrun, evn, product, tmp_product);
+        if(g_compute == "sleep") {
+            args->timer->sleep_for(draw_wait_time(mte));
+        } else {
+            run_compute_kernel(tmp_product);
+        }
+        args->stats->add(product.size(), MPI_Wtime() - t1);
+    }
+}
+
+static void run_ults_driver(const hepnos::SubRun& subrun,
+                            const std::vector<dummy_product>& products,
+                            std::atomic<hepnos::EventNumber>& next_event,
+                            std::vector<phase_stats>& lane_stats) {
+    // margo already initialized Argobots, this only takes a reference
+    ABT_init(0, nullptr);
+    // waiting pool and scheduler, so idle xstreams sleep while the ULTs are in simulated compute
+    ABT_pool pool;
+    ABT_pool_create_basic(ABT_POOL_FIFO_WAIT, ABT_POOL_ACCESS_MPMC, ABT_TRUE, &pool);
+    std::vector<ABT_xstream> xstreams(std::max(g_io_threads, 1u));
+    for(auto& xstream : xstreams)
+        ABT_xstream_create_basic(ABT_SCHED_BASIC_WAIT, 1, &pool, ABT_SCHED_CONFIG_NULL, &xstream);
+
+    ult_timer timer;
+    std::vector<ult_lane_args> args(g_concurrency);
+    std::vector<ABT_thread> ults(g_concurrency);
+    for(unsigned i = 0; i < g_concurrency; i++) {
+        args[i] = { &timer, &subrun, &products, &next_event, &lane_stats[i],
+                    g_rank * g_concurrency + i };
+        ABT_thread_create(pool, pipeline_ult, &args[i], ABT_THREAD_ATTR_NULL, &ults[i]);
+    }
+    for(auto& ult : ults)
+        ABT_thread_free(&ult);
+    for(auto& xstream : xstreams) {
+        ABT_xstream_join(xstream);
+        ABT_xstream_free(&xstream);
+    }
+    ABT_finalize();
+}
+
+struct pingpong_state {
+    std::mutex              mutex;
+    std::condition_variable cond;
+    ABT_mutex               abt_mutex;
+    ABT_cond                abt_cond;
+    int                     turn = 0;
+};
+
+struct pingpong_args {
+    pingpong_state* state;
+    int             id;
+};
+
+static void pingpong_ult(void* arg) {
+    auto args = static_cast<pingpong_args*>(arg);
+    auto state = args->state;
+    for(size_t i = 0; i < g_switch_iterations; i++) {
+        ABT_mutex_lock(state->abt_mutex);
+        while(state->turn != args->id)
+            ABT_cond_wait(state->abt_cond, state->abt_mutex);
+        state->turn = 1 - args->id;
+        ABT_cond_signal(state->abt_cond);
+        ABT_mutex_unlock(state->abt_mutex);
+    }
+}
+
+static double measure_ult_switch_time() {
+    ABT_init(0, nullptr);
+    ABT_pool pool;
+    ABT_xstream xstream;
+    ABT_pool_create_basic(ABT_POOL_FIFO, ABT_POOL_ACCESS_MPMC, ABT_TRUE, &pool);
+    ABT_xstream_create_basic(ABT_SCHED_DEFAULT, 1, &pool, ABT_SCHED_CONFIG_NULL, &xstream);
+    pingpong_state state;
+    ABT_mutex_create(&state.abt_mutex);
+    ABT_cond_create(&state.abt_cond);
+    pingpong_args args[2] = { { &state, 0 }, { &state, 1 } };
+    ABT_thread ults[2];
+    double t_start = MPI_Wtime();
+    for(int i = 0; i < 2; i++)
+        ABT_thread_create(pool, pingpong_ult, &args[i], ABT_THREAD_ATTR_NULL, &ults[i]);
+    for(int i = 0; i < 2; i++)
+        ABT_thread_free(&ults[i]);
+    double elapsed = MPI_Wtime() - t_start;
+    ABT_cond_free(&state.abt_cond);
+    ABT_mutex_free(&state.abt_mutex);
+    ABT_xstream_join(xstream);
+    ABT_xstream_free(&xstream);
+    ABT_finalize();
+    return elapsed / (2 * g_switch_iterations);
+}
+
+static double measure_thread_switch_time() {
+    pingpong_state state;
+    // both threads share one CPU, like the two ULTs sharing one xstream,
+    // so each handoff is a context switch rather than a cross-core wakeup
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(std::max(sched_getcpu(), 0), &cpus);
+    auto pingpong = [&state, &cpus](int id) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        for(size_t i = 0; i < g_switch_iterations; i++) {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.cond.wait(lock, [&]() { return state.turn == id; });
+            state.turn = 1 - id;
+            state.cond.notify_one();
+        }
+    };
+    double t_start = MPI_Wtime();
+    std::thread t0(pingpong, 0), t1(pingpong, 1);
+    t0.join();
+    t1.join();
+    return (MPI_Wtime() - t_start) / (2 * g_switch_iterations);
+}
+
+static void report_switch_time() {
+    double local_time = g_driver == "ults" ? measure_ult_switch_time() : measure_thread_switch_time();
+    double avg_time = 0.0;
+    MPI_Reduce(&local_time, &avg_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(g_rank == 0) {
+        spdlog::info("context switch driver={} iterations={} switch_time={:.9f}",
+                     g_driver, g_switch_iterations, avg_time / g_size);
+    }
+}
+
+#ifdef HEPNOS_BENCHMARK_COROUTINES
+static CoroutineScheduler::Task pipeline_coroutine(CoroutineScheduler& sched,
+                                                   const hepnos::SubRun& subrun,
+                                                   const std::vector<dummy_product>& products,
+                                                   std::atomic<hepnos::EventNumber>& next_event,
+                                                   phase_stats& stats, unsigned seed) {
+    std::mt19937 mte(seed);
+    hepnos::EventNumber evn;
+    while((evn = next_event++) < g_num_events) {
+        const auto& product = products[evn % products.size()];
+        double t1 = MPI_Wtime();
+        dummy_product tmp_product;
+        co_await sched.blocking([&]() {
+            store_and_load_back(subrun, evn, product, tmp_product);
+        });
+        if(g_compute == "sleep")
+            co_await sched.sleep_for(draw_wait_time(mte));
+        else
+            run_compute_kernel(tmp_product);
+        stats.add(product.size(), MPI_Wtime() - t1);
+    }
+}
+#endif
+
+static void run_derive_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async, hepnos::Run& run) {
+    auto subrun = run[g_rank];
+    std::string derived_label = g_derived_label.empty() ? g_product_label + "_derived" : g_derived_label;
+
+    measure_phase("derive_" + g_derived_store, op_process, [&](phase_stats& phase) {
+        {
+            std::unique_ptr<hepnos::WriteBatch> batch;
+            if(g_derived_store == "batch")
+                batch.reset(new hepnos::WriteBatch(datastore));
+            else if(g_derived_store == "async")
+                batch.reset(new hepnos::WriteBatch(async));
+
+            dummy_product raw_product, derived_product;
+            for(auto& event : subrun) {
+                double t1 = MPI_Wtime();
+                if(!event.load(g_product_label, raw_product)) {
+                    spdlog::error("Could not load product from event {}", event.number());
+                    continue;
+                }
+                simulate_compute(raw_product, g_mte);
+                // the derived payload is computed from the raw one and scaled by the ratio
+                size_t derived_size = (size_t)(raw_product.size() * g_derived_ratio);
+                derived_product.data.resize(derived_size);
+                for(size_t j = 0; j < derived_size; j++)
+                    derived_product.data[j] = raw_product.payload()[j % std::max<size_t>(raw_product.size(), 1)] ^ 0x5a;
+                if(batch)
+                    event.store(*batch, derived_label, derived_product);
+                else
+                    event.store(derived_label, derived_product);
+                phase.add(raw_product.size() + derived_size, MPI_Wtime() - t1);
+            }
+        }
+        if(g_derived_store == "async") async.wait();
+    });
+}
+
+static void run_create_phase(hepnos::DataStore& datastore) {
+    // every rank creates the dataset at the same time
+    size_t conflicts = 0;
+    hepnos::DataSet dataset;
+    measure_phase("create_dataset", op_create, [&](phase_stats& dataset_phase) {
+        double t1 = MPI_Wtime();
+        try {
+            dataset = datastore.root().createDataSet(g_input_dataset);
+        } catch(const hepnos::Exception& ex) {
+            conflicts += 1;
+            spdlog::debug("createDataSet failed: {}", ex.what());
+            dataset = datastore.root()[g_input_dataset];
+        }
+        dataset_phase.add(0, MPI_Wtime() - t1);
+    });
+
+    // then runs and subruns, either the same ones on all ranks or one set per rank
+    measure_phase("create_" + g_create_pattern, op_create, [&](phase_stats& run_phase) {
+        for(size_t i = 0; i < g_num_runs; i++) {
+            hepnos::RunNumber run_number = g_create_pattern == "same" ? i : i * g_size + g_rank;
+            double t1 = MPI_Wtime();
+            try {
+                auto run = dataset.createRun(run_number);
+                run.createSubRun(0);
+            } catch(const hepnos::Exception& ex) {
+                conflicts += 1;
+                spdlog::debug("createRun({}) failed: {}", run_number, ex.what());
+            }
+            run_phase.add(0, MPI_Wtime() - t1);
+        }
+    });
+
+    unsigned long local_conflicts = conflicts, total_conflicts = 0;
+    MPI_Reduce(&local_conflicts, &total_conflicts, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(g_rank != 0) return;
+    // check that the hierarchy ended up with exactly the expected runs and subruns
+    size_t expected = g_create_pattern == "same" ? g_num_runs : g_num_runs * g_size;
+    size_t num_runs = 0, num_subruns = 0;
+    for(auto& run : dataset.runs()) {
+        num_runs += 1;
+        for(auto& subrun : run) {
+            (void)subrun;
+            num_subruns += 1;
+        }
+    }
+    spdlog::info("creation pattern={} conflicts={} runs={} subruns={} expected={}",
+                 g_create_pattern, total_conflicts, num_runs, num_subruns, expected);
+    if(num_runs != expected || num_subruns != expected) {
+        spdlog::error("Concurrent creation produced {} runs and {} subruns, expected {}",
+                      num_runs, num_subruns, expected);
+    }
+}
+
+struct virtual_client_args {
+    ult_timer*                        timer;
+    hepnos::SubRun                    subrun;
+    const std::vector<dummy_product>* products;
+    hepnos::EventNumber               first_event;
+    phase_stats                       stats;
+    unsigned                          seed;
+};
+
+static void virtual_client_ult(void* arg) {
+    auto args = static_cast<virtual_client_args*>(arg);
+    std::mt19937 mte(args->seed);
+    const auto& products = *args->products;
+    for(hepnos::EventNumber evn = args->first_event; evn < args->first_event + g_num_events; evn++) {
+        const auto& product = products[evn % products.size()];
+        // clients in think time are suspended, the others keep the service busy
+        args->timer->sleep_for(draw_wait_time(mte));
+        double t1 = MPI_Wtime();
+        dummy_product tmp_product;
+        store_and_load_back(args->subrun, evn, product, tmp_product);
+        args->stats.add(2 * product.size(), MPI_Wtime() - t1);
+    }
+}
+
+static void run_virtual_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    // each logical client owns a subrun and issues its own request stream
+    std::vector<hepnos::SubRun> subruns;
+    for(unsigned c = 0; c < g_virtual_clients; c++)
+        subruns.push_back(run.createSubRun(g_rank * g_virtual_clients + c));
+
+    // margo already initialized Argobots, this only takes a reference
+    ABT_init(0, nullptr);
+    // waiting pool and scheduler, so xstreams sleep when every client is thinking
+    // instead of competing with margo's progress loop for the cores
+    ABT_pool pool;
+    ABT_pool_create_basic(ABT_POOL_FIFO_WAIT, ABT_POOL_ACCESS_MPMC, ABT_TRUE, &pool);
+    std::vector<ABT_xstream> xstreams(std::max(g_io_threads, 1u));
+    for(auto& xstream : xstreams)
+        ABT_xstream_create_basic(ABT_SCHED_BASIC_WAIT, 1, &pool, ABT_SCHED_CONFIG_NULL, &xstream);
+    ult_timer timer;
+
+    // powers of two up to g_virtual_clients give the scaling curve
+    std::vector<std::pair<unsigned, double>> curve;
+    hepnos::EventNumber first_event = 0;
+    for(unsigned num_clients = 1; ; num_clients = std::min(2 * num_clients, g_virtual_clients)) {
+        std::vector<virtual_client_args> args(num_clients);
+        std::vector<ABT_thread> ults(num_clients);
+        double ops_per_sec = measure_phase("virtual_" + std::to_string(num_clients), op_process,
+                                           [&](phase_stats& phase) {
+            for(unsigned c = 0; c < num_clients; c++) {
+                args[c].timer       = &timer;
+                args[c].subrun      = subruns[c];
+                args[c].products    = &products;
+                args[c].first_event = first_event;
+                args[c].seed        = g_rank * g_virtual_clients + c;
+                args[c].stats.op    = op_process;
+                ABT_thread_create(pool, virtual_client_ult, &args[c], ABT_THREAD_ATTR_NULL, &ults[c]);
+            }
+            for(auto& ult : ults)
+                ABT_thread_free(&ult);
+            for(const auto& a : args) phase.merge(a.stats);
+        });
+        curve.emplace_back(num_clients, ops_per_sec);
+        first_event += g_num_events;
+        if(num_clients == g_virtual_clients) break;
+    }
+
+    for(auto& xstream : xstreams) {
+        ABT_xstream_join(xstream);
+        ABT_xstream_free(&xstream);
+    }
+    ABT_finalize();
+
+    if(g_rank != 0) return;
+    for(const auto& point : curve) {
+        spdlog::info("virtual clients_per_rank={} logical_clients={} ops/s={:.2f} efficiency={:.3f}",
+                     point.first, point.first * g_size, point.second,
+                     curve[0].second > 0.0 ? point.second / (curve[0].second * point.first) : 0.0);
+    }
+}
+
+static void run_multiclient_phase(hepnos::DataStore& datastore, const std::vector<dummy_product>& products) {
+    // instance 0 is the rank's main connection, the others get their own margo instance
+    std::vector<hepnos::DataStore> datastores(1, datastore);
+    for(unsigned i = 1; i < g_client_instances; i++) {
+        try {
+            datastores.push_back(hepnos::DataStore::connect(g_protocol, g_connection_file, g_margo_file));
+        } catch(const hepnos::Exception& ex) {
+            spdlog::critical("Could not open DataStore instance {}: {}", i, ex.what());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    auto run = open_run(datastore, true);
+
+    // threads pick events from a shared counter and go through instance (thread % num_instances)
+    auto measure = [&](unsigned num_instances, hepnos::SubRunNumber subrun_number) {
+        hepnos::SubRunDescriptor subrun_descriptor;
+        run.createSubRun(subrun_number).toDescriptor(subrun_descriptor);
+        std::vector<hepnos::SubRun> subruns;
+        for(unsigned i = 0; i < num_instances; i++)
+            subruns.push_back(hepnos::SubRun::fromDescriptor(datastores[i], subrun_descriptor, false));
+        std::vector<phase_stats> thread_stats(g_concurrency);
+        for(auto& stats : thread_stats) stats.op = op_process;
+        std::atomic<hepnos::EventNumber> next_event(0);
+
+        return measure_phase("clients_" + std::to_string(num_instances), op_process,
+                             [&](phase_stats& phase) {
+            std::vector<std::thread> threads;
+            for(unsigned t = 0; t < g_concurrency; t++) {
+                threads.emplace_back([&, t]() {
+                    const auto& subrun = subruns[t % num_instances];
+                    hepnos::EventNumber evn;
+                    while((evn = next_event++) < g_num_events) {
+                        const auto& product = products[evn % products.size()];
+                        double t1 = MPI_Wtime();
+                        dummy_product tmp_product;
+                        store_and_load_back(subrun, evn, product, tmp_product);
+                        thread_stats[t].add(2 * product.size(), MPI_Wtime() - t1);
+                    }
+                });
+            }
+            for(auto& thread : threads) thread.join();
+            for(const auto& stats : thread_stats) phase.merge(stats);
+        });
+    };
+
+    double single = measure(1, g_rank);
+    double multi = g_client_instances > 1 ? measure(g_client_instances, g_size + g_rank) : single;
+    if(g_rank == 0 && single > 0.0) {
+        spdlog::info("multiclient threads={} instances={} throughput gain={:.3f}",
+                     g_concurrency, g_client_instances, multi / single);
+    }
+}
+
+static void run_correlated_phase(hepnos::DataStore& datastore, const std::vector<dummy_product>& products) {
+    // the same products either all in one dataset under distinct labels,
+    // or split across datasets under the same label, as with raw/calibration data
+    size_t n = g_num_datasets;
+    std::vector<std::string> labels;
+    for(size_t i = 0; i < n; i++)
+        labels.push_back(g_product_label + std::to_string(i));
+    auto single_subrun = open_run(datastore, true, g_input_dataset + "_single").createSubRun(g_rank);
+    std::vector<hepnos::SubRun> split_subruns;
+    for(size_t i = 0; i < n; i++) {
+        auto run = open_run(datastore, true, g_input_dataset + "_split" + std::to_string(i));
+        split_subruns.push_back(run.createSubRun(g_rank));
+    }
+    auto expected = [&products](hepnos::EventNumber evn, size_t i) -> const dummy_product& {
+        return products[(evn + i) % products.size()];
+    };
+
+    measure_events("single_dataset_store", op_store, [&](hepnos::EventNumber evn) {
+        size_t bytes = 0;
+        auto event = single_subrun.createEvent(evn);
+        for(size_t i = 0; i < n; i++) {
+            event.store(labels[i], expected(evn, i));
+            bytes += expected(evn, i).size();
+        }
+        return bytes;
+    });
+    measure_events("multi_dataset_store", op_store, [&](hepnos::EventNumber evn) {
+        size_t bytes = 0;
+        for(size_t i = 0; i < n; i++) {
+            split_subruns[i].createEvent(evn).store(g_product_label, expected(evn, i));
+            bytes += expected(evn, i).size();
+        }
+        return bytes;
+    });
+
+    double single = measure_events("single_dataset_read", op_load, [&](hepnos::EventNumber evn) {
+        size_t bytes = 0;
+        auto event = single_subrun[evn];
+        for(size_t i = 0; i < n; i++) {
+            dummy_product tmp_product;
+            event.load(labels[i], tmp_product);
+            if(tmp_product != expected(evn, i))
+                spdlog::error("Loaded product doesn't match stored product!");
+            bytes += tmp_product.size();
+        }
+        return bytes;
+    });
+    double multi = measure_events("multi_dataset_read", op_load, [&](hepnos::EventNumber evn) {
+        size_t bytes = 0;
+        for(size_t i = 0; i < n; i++) {
+            dummy_product tmp_product;
+            split_subruns[i][evn].load(g_product_label, tmp_product);
+            if(tmp_product != expected(evn, i))
+                spdlog::error("Loaded product doesn't match stored product!");
+            bytes += tmp_product.size();
+        }
+        return bytes;
+    });
+
+    if(g_rank == 0 && multi > 0.0) {
+        spdlog::info("correlated datasets={} single/multi read throughput={:.3f}", n, single / multi);
+    }
+}
+
+static bool is_selected(hepnos::EventNumber evn) {
+    // deterministic hash so the selection looks random but is reproducible
+    uint64_t h = (evn + 1) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 31;
+    return (double)(h % 1000000) < g_selection_fraction * 1000000.0;
+}
+
+static void run_skim_phase(hepnos::DataStore& datastore, hepnos::AsyncEngine& async,
+                           hepnos::Run& run, const std::vector<dummy_product>& products) {
+    std::string summary_label = g_product_label + "_summary";
+    auto subrun = run.createSubRun(g_rank);
+    {
+        // the first byte of the summary product carries the selection decision
+        dummy_product summary;
+        summary.data.assign(g_summary_size, '\0');
+        measure_phase("skim_populate", op_store, [&](phase_stats& phase) {
+            for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+                const auto& product = products[evn % products.size()];
+                summary.data[0] = is_selected(evn) ? 1 : 0;
+                double t1 = MPI_Wtime();
+                auto event = subrun.createEvent(evn);
+                event.store(summary_label, summary);
+                event.store(g_product_label, product);
+                phase.add(summary.size() + product.size(), MPI_Wtime() - t1);
+            }
+        });
+    }
+
+    // every variant counts one op per event, with the bytes it actually loaded
+    size_t selected = 0;
+
+    double full_scan = measure_phase("skim_full_scan", op_load, [&](phase_stats& phase) {
+        for(auto& event : subrun) {
+            double t1 = MPI_Wtime();
+            dummy_product product;
+            attach_read_buffer(product);
+            event.load(g_product_label, product);
+            phase.add(product.size(), MPI_Wtime() - t1);
+        }
+    });
+
+    double skim = measure_phase("skim", op_load, [&](phase_stats& phase) {
+        for(auto& event : subrun) {
+            double t1 = MPI_Wtime();
+            dummy_product summary, product;
+            event.load(summary_label, summary);
+            if(summary.size() && summary.data[0]) {
+                attach_read_buffer(product);
+                event.load(g_product_label, product);
+                selected += 1;
+            }
+            phase.add(summary.size() + product.size(), MPI_Wtime() - t1);
+        }
+    });
+
+    // summaries come in batches with the events, waveforms are still loaded on demand
+    double skim_prefetch = measure_phase("skim_prefetch", op_load, [&](phase_stats& phase) {
+        hepnos::Prefetcher prefetcher(datastore);
+        prefetcher.fetchProduct<std::string, dummy_product>(summary_label);
+        for(auto it = subrun.begin(prefetcher); it != subrun.end(); ++it) {
+            double t1 = MPI_Wtime();
+            dummy_product summary, product;
+            it->load(prefetcher, summary_label, summary);
+            if(summary.size() && summary.data[0]) {
+                attach_read_buffer(product);
+                it->load(g_product_label, product);
+            }
+            phase.add(summary.size() + product.size(), MPI_Wtime() - t1);
+        }
+    });
+
+    // the PEP spreads the whole dataset across ranks and preloads summaries only
+    auto dataset = open_dataset(datastore);
+    double skim_pep = measure_phase("skim_pep", op_load, [&](phase_stats& phase) {
+        std::mutex phase_mutex;
+        hepnos::ParallelEventProcessor pep(async, MPI_COMM_WORLD);
+        pep.preload<dummy_product>(summary_label);
+        pep.process(dataset, [&](const hepnos::Event& event, const hepnos::ProductCache& cache) {
+            double t1 = MPI_Wtime();
+            dummy_product summary, product;
+            if(!event.load(cache, summary_label, summary)) return;
+            if(summary.size() && summary.data[0])
+                event.load(g_product_label, product);
+            std::lock_guard<std::mutex> lock(phase_mutex);
+            phase.add(summary.size() + product.size(), MPI_Wtime() - t1);
+        });
+    });
+
+    unsigned long local_selected = selected, total_selected = 0;
+    MPI_Reduce(&local_selected, &total_selected, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if(g_rank == 0 && full_scan > 0.0) {
+        spdlog::info("skim fraction={} selected={}/{} speedup skim={:.3f} prefetch={:.3f} pep={:.3f}",
+                     g_selection_fraction, total_selected, g_num_events * g_size,
+                     skim / full_scan, skim_prefetch / full_scan, skim_pep / full_scan);
+    }
+}
+
+static std::vector<std::string> make_labels() {
+    std::vector<std::string> labels;
+    for(size_t i = 0; i < g_label_count; i++) {
+        std::string label = g_product_label + std::to_string(i);
+        // pad at the end so labels stay distinct whatever the length
+        if(label.size() < g_label_length) label.append(g_label_length - label.size(), '_');
+        labels.push_back(std::move(label));
+    }
+    return labels;
+}
+
+template<typename T>
+static void run_label_phases(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    auto labels = make_labels();
+    auto subrun = run.createSubRun(g_rank);
+    std::vector<T> typed_products(products.size());
+    for(size_t i = 0; i < products.size(); i++)
+        typed_products[i].data.assign(products[i].payload(), products[i].size());
+
+    measure_phase("label_store", op_store, [&](phase_stats& store_phase) {
+        for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+            auto event = subrun.createEvent(evn);
+            for(size_t i = 0; i < labels.size(); i++) {
+                const auto& product = typed_products[(evn + i) % typed_products.size()];
+                double t1 = MPI_Wtime();
+                hepnos::StoreStatistics stats;
+                event.store(labels[i], product, &stats);
+                store_phase.add(product.size(), MPI_Wtime() - t1,
+                                stats.raw_storage_time.max, stats.serialization_time.max);
+            }
+        }
+    });
+
+    measure_phase("label_load", op_load, [&](phase_stats& load_phase) {
+        for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+            auto event = subrun[evn];
+            for(size_t i = 0; i < labels.size(); i++) {
+                const auto& product = typed_products[(evn + i) % typed_products.size()];
+                double t1 = MPI_Wtime();
+                T tmp_product;
+                attach_read_buffer(tmp_product);
+                hepnos::LoadStatistics stats;
+                event.load(labels[i], tmp_product, &stats);
+                load_phase.add(tmp_product.size(), MPI_Wtime() - t1,
+                               stats.raw_loading_time.max, stats.deserialization_time.max);
+                if(tmp_product != product) {
+                    spdlog::error("Loaded product doesn't match stored product!");
+                }
+            }
+        }
+    });
+
+    if(g_rank == 0) {
+        // product keys are <event key><label>#<type name>, only the suffix varies here
+        auto type_name = product_type_name<T>();
+        spdlog::info("labels count={} label_length={} type_name={} type_name_length={} "
+                     "key_suffix_bytes={} keys={}",
+                     labels.size(), labels[0].size(), type_name, type_name.size(),
+                     labels[0].size() + 1 + type_name.size(), g_num_events * labels.size() * g_size);
+    }
+}
+
+static void run_labels_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    namespace sp = icarus::reconstruction::tpc::signal_processing;
+    if(g_type_name == "short")
+        run_label_phases<icarus::lbl_product>(run, products);
+    else if(g_type_name == "medium")
+        run_label_phases<icarus::raw_digit_waveform_product>(run, products);
+    else
+        run_label_phases<sp::deconvolved_wire_waveform_region_of_interest_product>(run, products);
+}
+
+static void run_hot_phase(hepnos::DataStore& datastore, hepnos::Run& run,
+                          const std::vector<dummy_product>& products) {
+    // the hot product (e.g. geometry) is the last product size, stored once
+    const auto& hot_product = products.back();
+    std::string hot_label = g_product_label + "_hot";
+    hepnos::SubRunDescriptor subrun_descriptor;
+    if(g_rank == 0) {
+        auto subrun = run.createSubRun(0);
+        subrun.createEvent(0).store(hot_label, hot_product);
+        subrun.toDescriptor(subrun_descriptor);
+    }
+    MPI_Bcast(&subrun_descriptor, sizeof(subrun_descriptor), MPI_BYTE, 0, MPI_COMM_WORLD);
+    auto subrun = hepnos::SubRun::fromDescriptor(datastore, subrun_descriptor, false);
+    size_t hot_size = hot_product.size();
+    if(hot_size > (size_t)INT_MAX) {
+        spdlog::critical("Hot product of {} bytes is more than MPI can broadcast in one call ({}), "
+                         "reduce --product-sizes", hot_size, INT_MAX);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // all ranks fetch in lockstep, so every fetch contends with every other rank's
+    auto measure = [&hot_product](const std::string& name, const std::function<void(dummy_product&)>& fetch) {
+        measure_phase(name, op_load, [&](phase_stats& phase) {
+            for(size_t i = 0; i < g_num_events; i++) {
+                MPI_Barrier(MPI_COMM_WORLD);
+                double t1 = MPI_Wtime();
+                dummy_product tmp_product;
+                fetch(tmp_product);
+                phase.add(tmp_product.size(), MPI_Wtime() - t1);
+                if(tmp_product != hot_product) {
+                    spdlog::error("Hot product doesn't match stored product!");
+                }
+            }
+        });
+    };
+
+    // every rank hits the same key on the same provider
+    measure("hot_all_load", [&](dummy_product& product) {
+        subrun[0].load(hot_label, product);
+    });
+
+    // one rank loads, then broadcasts
+    measure("hot_bcast", [&](dummy_product& product) {
+        if(g_rank == 0) subrun[0].load(hot_label, product);
+        else product.data.resize(hot_size);
+        MPI_Bcast(&product.data[0], (int)hot_size, MPI_BYTE, 0, MPI_COMM_WORLD);
+    });
+
+    // one load per node into a shared window that the node's ranks read from
+    char* shared = nullptr;
+    MPI_Win win;
+    MPI_Win_allocate_shared(g_node_rank == 0 ? hot_size : 0, 1, MPI_INFO_NULL,
+                            g_node_comm, &shared, &win);
+    MPI_Aint segment_size;
+    int disp_unit;
+    MPI_Win_shared_query(win, 0, &segment_size, &disp_unit, &shared);
+    measure("hot_node_shm", [&](dummy_product& product) {
+        if(g_node_rank == 0) {
+            product.external_data     = shared;
+            product.external_capacity = hot_size;
+            subrun[0].load(hot_label, product);
+        }
+        MPI_Win_fence(0, win);
+        product.external_data = shared;
+        product.external_size = hot_size;
+    });
+    MPI_Win_free(&win);
+}
+
+static void run_spill_phase(hepnos::Run& run, const std::vector<dummy_product>& products) {
+    auto subrun = run.createSubRun(g_rank);
+
+    // events arrive in bursts and wait in a client-side backlog until stored
+    std::mutex backlog_mutex;
+    std::condition_variable backlog_cv;
+    std::deque<std::pair<hepnos::EventNumber, double>> backlog;
+    size_t backlog_events = 0, backlog_bytes = 0;
+    size_t peak_backlog_events = 0, peak_backlog_bytes = 0;
+    bool producer_done = false;
+
+    size_t num_spills = (g_num_events + g_events_per_spill - 1) / g_events_per_spill;
+    double on_time = g_spill_period * g_duty_cycle;
+    size_t overruns = 0;
+    double max_drain_time = 0.0;
+    double last_arrival = 0.0;
+
+    measure_phase("spill_ingest", op_store, [&](phase_stats& phase) {
+        // spills are scheduled relative to the start of the phase
+        double t_start = MPI_Wtime();
+        std::thread consumer([&]() {
+            while(true) {
+                std::pair<hepnos::EventNumber, double> item;
+                {
+                    std::unique_lock<std::mutex> lock(backlog_mutex);
+                    backlog_cv.wait(lock, [&]() { return producer_done || !backlog.empty(); });
+                    if(backlog.empty()) break;
+                    item = backlog.front();
+                    backlog.pop_front();
+                }
+                const auto& product = products[item.first % products.size()];
+                hepnos::StoreStatistics stats;
+                subrun.createEvent(item.first).store(g_product_label, product, &stats);
+                double now = MPI_Wtime();
+                std::lock_guard<std::mutex> lock(backlog_mutex);
+                phase.add(product.size(), now - item.second,
+                          stats.raw_storage_time.max, stats.serialization_time.max);
+                backlog_events -= 1;
+                backlog_bytes  -= product.size();
+                if(backlog_events == 0)
+                    max_drain_time = std::max(max_drain_time, now - last_arrival);
+            }
+        });
+
+        hepnos::EventNumber evn = 0;
+        for(size_t spill = 0; spill < num_spills; spill++) {
+            double spill_start = t_start + spill * g_spill_period;
+            {
+                std::lock_guard<std::mutex> lock(backlog_mutex);
+                if(spill != 0 && backlog_events != 0) overruns += 1;
+            }
+            size_t spill_events = std::min<size_t>(g_events_per_spill, g_num_events - evn);
+            for(size_t i = 0; i < spill_events; i++, evn++) {
+                double arrival = spill_start + i * on_time / g_events_per_spill;
+                double now = MPI_Wtime();
+                if(arrival > now)
+                    std::this_thread::sleep_for(std::chrono::duration<double>(arrival - now));
+                const auto& product = products[evn % products.size()];
+                std::lock_guard<std::mutex> lock(backlog_mutex);
+                backlog.emplace_back(evn, MPI_Wtime());
+                backlog_events += 1;
+                backlog_bytes  += product.size();
+                last_arrival = backlog.back().second;
+                peak_backlog_events = std::max(peak_backlog_events, backlog_events);
+                peak_backlog_bytes  = std::max(peak_backlog_bytes, backlog_bytes);
+                backlog_cv.notify_one();
+            }
+            double next_spill = t_start + (spill + 1) * g_spill_period;
+            double now = MPI_Wtime();
+            if(spill + 1 < num_spills && next_spill > now)
+                std::this_thread::sleep_for(std::chrono::duration<double>(next_spill - now));
+        }
+        {
+            std::lock_guard<std::mutex> lock(backlog_mutex);
+            producer_done = true;
+        }
+        backlog_cv.notify_one();
+        consumer.join();
+    });
+
+    unsigned long local_values[3] = { peak_backlog_events, peak_backlog_bytes, overruns };
+    unsigned long max_values[3] = { 0, 0, 0 };
+    double max_drain = 0.0;
+    MPI_Reduce(local_values, max_values, 3, MPI_UNSIGNED_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&max_drain_time, &max_drain, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(g_rank == 0) {
+        spdlog::info("spill period={} duty_cycle={} spills={} events_per_spill={} "
+                     "peak_backlog_events={} peak_backlog_bytes={} overruns={} max_drain_time={:.6f}",
+                     g_spill_period, g_duty_cycle, num_spills, g_events_per_spill,
+                     max_values[0], max_values[1], max_values[2], max_drain);
+    }
+}
+
+static void run_calibration(hepnos::DataStore& datastore) {
+    // MPI point-to-point between rank 0 and the first rank of another node,
+    // or rank 1 when everything runs on a single node
+    int candidate = (g_node_rank == 0 && g_rank != 0) ? g_rank : g_size;
+    int partner = g_size;
+    MPI_Allreduce(&candidate, &partner, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    bool inter_node = partner < g_size;
+    if(!inter_node && g_size > 1) partner = 1;
+
+    double mpi_latency = 0.0, mpi_bandwidth = 0.0;
+    if(partner < g_size && (g_rank == 0 || g_rank == partner)) {
+        int peer = g_rank == 0 ? partner : 0;
+        const int latency_iterations = 1000, bandwidth_iterations = 20;
+        const size_t message_size = 4*1024*1024;
+        std::vector<char> buffer(message_size);
+        double t_start = MPI_Wtime();
+        for(int i = 0; i < latency_iterations; i++) {
+            if(g_rank == 0) {
+                MPI_Send(buffer.data(), 8, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+                MPI_Recv(buffer.data(), 8, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            } else {
+                MPI_Recv(buffer.data(), 8, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                MPI_Send(buffer.data(), 8, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+            }
+        }
+        mpi_latency = (MPI_Wtime() - t_start) / (2 * latency_iterations);
+        t_start = MPI_Wtime();
+        for(int i = 0; i < bandwidth_iterations; i++) {
+            if(g_rank == 0) {
+                MPI_Send(buffer.data(), message_size, MPI_BYTE, peer, 1, MPI_COMM_WORLD);
+                MPI_Recv(buffer.data(), 1, MPI_BYTE, peer, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            } else {
+                MPI_Recv(buffer.data(), message_size, MPI_BYTE, peer, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                MPI_Send(buffer.data(), 1, MPI_BYTE, peer, 1, MPI_COMM_WORLD);
+            }
+        }
+        mpi_bandwidth = (double)message_size * bandwidth_iterations / (MPI_Wtime() - t_start);
+    }
+    MPI_Bcast(&mpi_latency, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&mpi_bandwidth, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    // memcpy bandwidth, with all ranks of a node copying at the same time
+    double memcpy_bandwidth = 0.0;
+    {
+        const size_t copy_size = 64*1024*1024;
+        const int copy_iterations = 10;
+        std::vector<char> src(copy_size, 1), dst(copy_size, 0);
+        std::memcpy(dst.data(), src.data(), copy_size);
+        MPI_Barrier(g_node_comm);
+        double t_start = MPI_Wtime();
+        for(int i = 0; i < copy_iterations; i++) {
+            src[i] = (char)i;
+            std::memcpy(dst.data(), src.data(), copy_size);
+        }
+        double local_bandwidth = (double)copy_size * copy_iterations / (MPI_Wtime() - t_start);
+        MPI_Allreduce(&local_bandwidth, &memcpy_bandwidth, 1, MPI_DOUBLE, MPI_SUM, g_node_comm);
+    }
+
+    // minimal HEPnOS round-trip: looking up an existing dataset by name; the
+    // workload's dataset may not exist yet, and timing a miss would be misleading
+    double rpc_latency = 0.0;
+    {
+        const int lookup_iterations = 100;
+        std::string calibration_dataset = g_input_dataset + "_calibration";
+        auto root = datastore.root();
+        if(g_rank == 0) {
+            try {
+                root.createDataSet(calibration_dataset);
+            } catch(const hepnos::Exception& ex) {
+                spdlog::critical("Could not create dataset {}: {}", calibration_dataset, ex.what());
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if(root.find(calibration_dataset) == root.end()) {
+            spdlog::error("Calibration dataset {} not found, RPC latency is that of a miss",
+                          calibration_dataset);
+        }
+        double t_start = MPI_Wtime();
+        for(int i = 0; i < lookup_iterations; i++)
+            root.find(calibration_dataset);
+        double local_latency = (MPI_Wtime() - t_start) / lookup_iterations;
+        MPI_Allreduce(&local_latency, &rpc_latency, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        rpc_latency /= g_size;
+    }
+
+    int is_leader = g_node_rank == 0, num_nodes = 0;
+    MPI_Allreduce(&is_leader, &num_nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    double min_memcpy_bandwidth = 0.0;
+    MPI_Allreduce(&memcpy_bandwidth, &min_memcpy_bandwidth, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+
+    g_calibration.mpi_latency      = mpi_latency;
+    g_calibration.mpi_bandwidth    = mpi_bandwidth;
+    g_calibration.memcpy_bandwidth = min_memcpy_bandwidth;
+    g_calibration.rpc_latency      = rpc_latency;
+    g_calibration.num_nodes        = num_nodes;
+
+    if(g_rank == 0) {
+        spdlog::info("calibration nodes={} mpi_{}_latency={:.9f} mpi_bandwidth_MB/s={:.3f} "
+                     "node_memcpy_MB/s={:.3f} hepnos_rpc_latency={:.9f}",
+                     num_nodes, inter_node ? "inter_node" : "intra_node", mpi_latency,
+                     mpi_bandwidth / (1024.0*1024.0), min_memcpy_bandwidth / (1024.0*1024.0),
+                     rpc_latency);
+    }
+}
+
+/**
+ * Runs body between two barriers and reports it as a phase whose samples
+ * are tagged with op. Returns the phase's ops/s on rank 0.
+ */
+static double measure_phase(const std::string& name, uint8_t op,
+                            const std::function<void(phase_stats&)>& body) {
+    phase_stats phase;
+    phase.op = op;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t_start = MPI_Wtime();
+    body(phase);
+    double t_end = MPI_Wtime();
+    MPI_Barrier(MPI_COMM_WORLD);
+    return report_phase(name, phase, t_end - t_start);
+}
+
+/**
+ * measure_phase() calling body once per event number, each call being
+ * one operation of the number of bytes it returns.
+ */
+static double measure_events(const std::string& name, uint8_t op,
+                             const std::function<size_t(hepnos::EventNumber)>& body) {
+    return measure_phase(name, op, [&body](phase_stats& phase) {
+        for(hepnos::EventNumber evn = 0; evn < g_num_events; evn++) {
+            double t1 = MPI_Wtime();
+            size_t bytes = body(evn);
+            phase.add(bytes, MPI_Wtime() - t1);
+        }
+    });
+}
+
+static double report_phase(const std::string& phase, const phase_stats& stats, double elapsed) {
+    unsigned long local_counts[2] = { stats.num_ops, stats.num_bytes };
+    unsigned long total_counts[2] = { 0, 0 };
+    double latency_sum = 0.0, latency_max = 0.0, max_elapsed = 0.0, sum_elapsed = 0.0;
+    MPI_Reduce(local_counts, total_counts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&elapsed, &sum_elapsed, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&stats.latency_sum, &latency_sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&stats.latency_max, &latency_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    long page_faults = get_page_faults();
+    long local_faults = page_faults - g_last_page_faults, total_faults = 0;
+    g_last_page_faults = page_faults;
+    MPI_Reduce(&local_faults, &total_faults, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    report_nodes(phase, stats, elapsed);
+    if(!g_sample_prefix.empty()) {
+        std::ofstream ofs(g_sample_prefix + "." + std::to_string(g_rank) + ".bin",
+                          std::ios::binary | std::ios::app);
+        stats.samples.write(ofs, g_rank, phase);
+        if(!ofs.good()) spdlog::error("Could not write samples for phase {}", phase);
+    }
+    if(g_rank != 0) return 0.0;
+    double latency_avg = total_counts[0] ? latency_sum / total_counts[0] : 0.0;
+    double ops_per_sec = max_elapsed > 0.0 ? total_counts[0] / max_elapsed : 0.0;
+    double mb_per_sec  = max_elapsed > 0.0 ? total_counts[1] / max_elapsed / (1024.0*1024.0) : 0.0;
+    // "summary" lines are parsed by the scripts in run/, keep their format stable
+    spdlog::info("summary dataset={} role={} phase={} ops={} bytes={} time={:.6f} "
+                 "ops/s={:.2f} MB/s={:.3f} latency_avg={:.6f} latency_max={:.6f} page_faults={} "
+                 "imbalance={:.3f}",
+                 g_input_dataset, g_role, phase, total_counts[0], total_counts[1],
+                 max_elapsed, ops_per_sec, mb_per_sec, latency_avg, latency_max, total_faults,
+                 sum_elapsed > 0.0 ? max_elapsed * g_size / sum_elapsed : 1.0);
+    if(g_calibration.done) {
+        double bytes_per_sec = max_elapsed > 0.0 ? total_counts[1] / max_elapsed : 0.0;
+        auto fraction = [](double x, double y) { return y > 0.0 ? x / y : 0.0; };
+        spdlog::info("calibrated phase={} latency_in_rpcs={:.2f} network_fraction={:.4f} "
+                     "memcpy_fraction={:.4f}", phase,
+                     fraction(latency_avg, g_calibration.rpc_latency),
+                     fraction(bytes_per_sec, g_calibration.num_nodes * g_calibration.mpi_bandwidth),
+                     fraction(bytes_per_sec, g_calibration.num_nodes * g_calibration.memcpy_bandwidth));
+    }
+    return ops_per_sec;
+}
+
+static void report_nodes(const std::string& phase, const phase_stats& stats, double elapsed) {
+    unsigned long local_counts[2] = { stats.num_ops, stats.num_bytes };
+    unsigned long node_counts[2] = { 0, 0 };
+    double node_elapsed = 0.0;
+    MPI_Reduce(local_counts, node_counts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, g_node_comm);
+    MPI_Reduce(&elapsed, &node_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, g_node_comm);
+    if(g_leader_comm == MPI_COMM_NULL) return;
+
+    int num_nodes;
+    MPI_Comm_size(g_leader_comm, &num_nodes);
+    // per node: ranks, ops/s, MB/s
+    double node_metrics[3] = {
+        (double)g_node_size,
+        node_elapsed > 0.0 ? node_counts[0] / node_elapsed : 0.0,
+        node_elapsed > 0.0 ? node_counts[1] / node_elapsed / (1024.0*1024.0) : 0.0
+    };
+    std::vector<double> all_metrics(g_rank == 0 ? 3 * num_nodes : 0);
+    MPI_Gather(node_metrics, 3, MPI_DOUBLE, all_metrics.data(), 3, MPI_DOUBLE, 0, g_leader_comm);
+    char hostname[MPI_MAX_PROCESSOR_NAME] = { 0 };
+    int len;
+    MPI_Get_processor_name(hostname, &len);
+    std::vector<char> all_hostnames(g_rank == 0 ? MPI_MAX_PROCESSOR_NAME * num_nodes : 0);
+    MPI_Gather(hostname, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, all_hostnames.data(),
+               MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, g_leader_comm);
+    if(g_rank != 0) return;
+
+    double min_bw = all_metrics[2], max_bw = all_metrics[2], sum_bw = 0.0, sum_bw2 = 0.0;
+    double min_ops = all_metrics[1], max_ops = all_metrics[1];
+    int min_ranks = (int)all_metrics[0], max_ranks = (int)all_metrics[0];
+    int slowest = 0;
+    for(int i = 0; i < num_nodes; i++) {
+        int ranks = (int)all_metrics[3*i];
+        double ops = all_metrics[3*i+1], bw = all_metrics[3*i+2];
+        min_ranks = std::min(min_ranks, ranks);
+        max_ranks = std::max(max_ranks, ranks);
+        if(bw < min_bw) { min_bw = bw; slowest = i; }
+        max_bw   = std::max(max_bw, bw);
+        min_ops  = std::min(min_ops, ops);
+        max_ops  = std::max(max_ops, ops);
+        sum_bw  += bw;
+        sum_bw2 += bw * bw;
+        if(g_per_node_details) {
+            spdlog::info("node phase={} host={} ranks={} ops/s={:.2f} MB/s={:.3f}", phase,
+                         &all_hostnames[i * MPI_MAX_PROCESSOR_NAME], ranks, ops, bw);
+        }
+    }
+    double avg_bw = sum_bw / num_nodes;
+    double stddev_bw = std::sqrt(std::max(0.0, sum_bw2 / num_nodes - avg_bw * avg_bw));
+    spdlog::info("nodes phase={} nodes={} ranks_per_node={}-{} node_ops/s={:.2f}-{:.2f} "
+                 "node_MB/s min={:.3f} avg={:.3f} max={:.3f} stddev={:.3f} slowest={}",
+                 phase, num_nodes, min_ranks, max_ranks, min_ops, max_ops,
+                 min_bw, avg_bw, max_bw, stddev_bw,
+                 &all_hostnames[slowest * MPI_MAX_PROCESSOR_NAME]);
+}
+
+static long get_max_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Proportional set size of the process, 0 if /proc/self/smaps_rollup
+ * is not available (Linux < 4.14).
+ */
+static long get_pss_kb() {
+    std::ifstream ifs("/proc/self/smaps_rollup");
+    std::string line;
+    while(std::getline(ifs, line)) {
+        if(line.compare(0, 4, "Pss:") == 0)
+            return std::atol(line.c_str() + 4);
+    }
+    return 0;
+}
+
+/**
+ * Resets the peak RSS of the process (Linux >= 4.0), so that the
+ * next get_peak_rss_kb() reports the peak of the current phase.
+ */
+static void reset_peak_rss() {
+    std::ofstream ofs("/proc/self/clear_refs");
+    ofs << "5";
+}
+
+static long get_peak_rss_kb() {
+    std::ifstream ifs("/proc/self/status");
+    std::string line;
+    while(std::getline(ifs, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0)
+            return std::atol(line.c_str() + 6);
+    }
+    // no procfs, fall back to the lifetime peak
+    return get_max_rss_kb();
+}
+
+static long get_page_faults() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+static void apply_skew() {
+    if(g_skew == "none") return;
+    if(g_aggregate || g_load_by_id || g_shared_buffers || g_role == "hot") {
+        if(g_rank == 0) {
+            spdlog::critical("--skew requires identical products on all ranks and cannot be used "
+                             "with --aggregate, --load-by-id, --shared-buffers or the hot role");
+        }
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        exit(-1);
+    }
+    // weights are normalized to an average of 1 so the total volume is unchanged
+    std::vector<double> weights(g_size);
+    double sum = 0.0;
+    for(int r = 0; r < g_size; r++) {
+        if(g_skew == "linear")
+            weights[r] = 1.0 + (g_skew_factor - 1.0) * r / std::max(g_size - 1, 1);
+        else
+            weights[r] = 1.0 / std::pow(r + 1, g_skew_factor);
+        sum += weights[r];
+    }
+    double weight = weights[g_rank] * g_size / sum;
+    // the weight is split between the event count and the product sizes
+    double scale = std::sqrt(weight);
+    g_num_events = std::max<size_t>(1, std::llround(g_num_events * scale));
+    for(auto& size : g_product_sizes)
+        size = std::max<size_t>(1, std::llround(size * scale));
+    spdlog::debug("skew {} gives weight {}: {} events, sizes scaled by {}",
+                  g_skew, weight, g_num_events, scale);
+}
+
 static std::string check_file_exists(const std::string& filename) {
     spdlog::trace("Checking if file {} exists", filename);
     std::ifstream ifs(filename);
@@ -249,5 +2632,10 @@ static std::vector<size_t> parse_product_sizes(const std::string& str) {
         if(ss.peek() == ',')
             ss.ignore();
     }
+    if(result.empty()) {
+        spdlog::critical("Invalid product sizes \"{}\", expected a comma-separated list of sizes", str);
+        MPI_Abort(MPI_COMM_WORLD, -1);
+        exit(-1);
+    }
     return result;
 }
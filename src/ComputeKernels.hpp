@@ -0,0 +1,127 @@
+#ifndef __COMPUTE_KERNELS_H
+#define __COMPUTE_KERNELS_H
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Synthetic compute kernels run on loaded product payloads in place of
+ * a plain sleep. Their cost scales with the payload size and they touch
+ * the data, so they compete for caches and memory bandwidth the way
+ * reconstruction code does. Each returns a checksum so the work cannot
+ * be optimized away.
+ */
+namespace compute_kernels {
+
+/**
+ * Waveform deconvolution: the payload is read as 8-bit samples, split in
+ * blocks of 1024, transformed with a radix-2 FFT, divided by a detector
+ * response and transformed back.
+ */
+inline double deconvolution(const char* data, size_t size) {
+    const size_t block = 1024;
+    std::vector<std::complex<float>> samples(block);
+    double checksum = 0.0;
+    auto fft = [&](bool inverse) {
+        size_t n = samples.size();
+        for(size_t i = 1, j = 0; i < n; i++) {
+            size_t bit = n >> 1;
+            for(; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+            if(i < j) std::swap(samples[i], samples[j]);
+        }
+        for(size_t len = 2; len <= n; len <<= 1) {
+            float angle = 2.0f * (float)M_PI / len * (inverse ? 1.0f : -1.0f);
+            std::complex<float> wlen(std::cos(angle), std::sin(angle));
+            for(size_t i = 0; i < n; i += len) {
+                std::complex<float> w(1.0f);
+                for(size_t k = 0; k < len / 2; k++) {
+                    auto u = samples[i+k];
+                    auto v = samples[i+k+len/2] * w;
+                    samples[i+k]         = u + v;
+                    samples[i+k+len/2]   = u - v;
+                    w *= wlen;
+                }
+            }
+        }
+    };
+    for(size_t offset = 0; offset < size; offset += block) {
+        size_t n = std::min(block, size - offset);
+        for(size_t i = 0; i < block; i++)
+            samples[i] = i < n ? (float)(uint8_t)data[offset + i] : 0.0f;
+        fft(false);
+        for(size_t i = 0; i < block; i++) {
+            // simple RC-shaped response, never zero
+            float f = (float)std::min(i, block - i) / block;
+            samples[i] /= std::complex<float>(1.0f, 4.0f * f);
+        }
+        fft(true);
+        for(size_t i = 0; i < n; i++)
+            checksum += samples[i].real() / block;
+    }
+    return checksum;
+}
+
+/**
+ * Hit finding: the payload is read as 8-bit samples, a running baseline
+ * is tracked and every excursion above the threshold is reported as a hit
+ * with its integrated charge.
+ */
+inline double hit_finding(const char* data, size_t size) {
+    const float threshold = 24.0f;
+    float baseline = size ? (float)(uint8_t)data[0] : 0.0f;
+    double charge = 0.0, total = 0.0;
+    size_t hits = 0;
+    bool in_hit = false;
+    for(size_t i = 0; i < size; i++) {
+        float sample = (float)(uint8_t)data[i];
+        float signal = sample - baseline;
+        if(signal > threshold) {
+            if(!in_hit) hits += 1;
+            in_hit = true;
+            charge += signal;
+        } else {
+            if(in_hit) total += charge;
+            in_hit = false;
+            charge = 0.0;
+            baseline += (sample - baseline) / 64.0f;
+        }
+    }
+    return total + charge + hits;
+}
+
+/**
+ * Buffers of the stream kernel, owned by the caller and reused across
+ * calls so allocation and first-touch page faults stay out of the timing.
+ */
+struct stream_scratch {
+    std::vector<double> a, b, c;
+};
+
+/**
+ * Memory-bound triad (a = b + s*c) over num_bytes worth of doubles,
+ * with b initialized from the payload.
+ */
+inline double stream(const char* data, size_t size, size_t num_bytes, stream_scratch& scratch) {
+    size_t n = std::max<size_t>(num_bytes / (3 * sizeof(double)), 1);
+    if(scratch.a.size() < n) {
+        scratch.a.resize(n);
+        scratch.b.resize(n);
+        scratch.c.resize(n, 0.5);
+    }
+    double* a = scratch.a.data();
+    double* b = scratch.b.data();
+    const double* c = scratch.c.data();
+    for(size_t i = 0; i < n; i++)
+        b[i] = size ? (double)(uint8_t)data[i % size] : 1.0;
+    const double s = 3.0;
+    for(size_t i = 0; i < n; i++)
+        a[i] = b[i] + s * c[i];
+    return a[0] + a[n-1] + a[n/2];
+}
+}
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef __COROUTINE_SCHEDULER_H
+#define __COROUTINE_SCHEDULER_H
+
+#include <coroutine>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <algorithm>
+#include <vector>
+
+/**
+ * Small scheduler for C++20 coroutines. Coroutines are resumed by a pool
+ * of worker threads. Blocking operations (HEPnOS calls) are handed to a
+ * separate pool of I/O threads and timed waits to a timer thread, so a
+ * suspended coroutine does not hold on to any thread.
+ */
+class CoroutineScheduler {
+
+    public:
+
+    /**
+     * Coroutine type for tasks run by the scheduler. A coroutine returning
+     * a Task must take the scheduler as its first parameter; it starts
+     * suspended and runs once passed to spawn(). Its frame is destroyed
+     * when it completes.
+     */
+    struct Task {
+        struct promise_type {
+            CoroutineScheduler& sched;
+
+            template<typename... Args>
+            promise_type(CoroutineScheduler& s, Args&&...)
+            : sched(s) {
+                sched.task_started();
+            }
+
+            ~promise_type() {
+                sched.task_done();
+            }
+
+            Task get_return_object() {
+                return Task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    CoroutineScheduler(unsigned num_workers, unsigned num_io_threads) {
+        for(unsigned i = 0; i < std::max(num_workers, 1u); i++)
+            m_threads.emplace_back([this]() { worker_loop(m_ready); });
+        for(unsigned i = 0; i < std::max(num_io_threads, 1u); i++)
+            m_threads.emplace_back([this]() { worker_loop(m_io); });
+        m_threads.emplace_back([this]() { timer_loop(); });
+    }
+
+    CoroutineScheduler(const CoroutineScheduler&) = delete;
+    CoroutineScheduler& operator=(const CoroutineScheduler&) = delete;
+
+    ~CoroutineScheduler() {
+        m_ready.close();
+        m_io.close();
+        {
+            std::lock_guard<std::mutex> lock(m_timer_mutex);
+            m_timer_closed = true;
+        }
+        m_timer_cv.notify_all();
+        for(auto& t : m_threads) t.join();
+    }
+
+    /**
+     * Schedules a task on one of the workers.
+     */
+    void spawn(Task task) {
+        auto h = task.handle;
+        m_ready.push([h]() { h.resume(); });
+    }
+
+    /**
+     * Blocks the calling (non-worker) thread until all
+     * spawned coroutines have completed.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> lock(m_pending_mutex);
+        m_pending_cv.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+    /**
+     * Awaitable running a blocking function on an I/O thread.
+     */
+    auto blocking(std::function<void()> fn) {
+        struct awaiter {
+            CoroutineScheduler* sched;
+            std::function<void()> fn;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) {
+                sched->m_io.push([s = sched, f = std::move(fn), h]() {
+                    f();
+                    s->m_ready.push([h]() { h.resume(); });
+                });
+            }
+            void await_resume() const noexcept {}
+        };
+        return awaiter{ this, std::move(fn) };
+    }
+
+    /**
+     * Awaitable suspending the coroutine for the given
+     * number of seconds without holding a thread.
+     */
+    auto sleep_for(double seconds) {
+        struct awaiter {
+            CoroutineScheduler* sched;
+            double seconds;
+            bool await_ready() const noexcept { return seconds <= 0.0; }
+            void await_suspend(std::coroutine_handle<> h) {
+                auto deadline = std::chrono::steady_clock::now()
+                              + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                    std::chrono::duration<double>(seconds));
+                {
+                    std::lock_guard<std::mutex> lock(sched->m_timer_mutex);
+                    sched->m_timers.push({ deadline, h });
+                }
+                sched->m_timer_cv.notify_one();
+            }
+            void await_resume() const noexcept {}
+        };
+        return awaiter{ this, seconds };
+    }
+
+    private:
+
+    class WorkQueue {
+
+        public:
+
+        void push(std::function<void()> f) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back(std::move(f));
+            }
+            m_cv.notify_one();
+        }
+
+        bool pop(std::function<void()>& f) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_closed || !m_queue.empty(); });
+            if(m_queue.empty()) return false;
+            f = std::move(m_queue.front());
+            m_queue.pop_front();
+            return true;
+        }
+
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+            }
+            m_cv.notify_all();
+        }
+
+        private:
+
+        std::mutex                        m_mutex;
+        std::condition_variable           m_cv;
+        std::deque<std::function<void()>> m_queue;
+        bool                              m_closed = false;
+    };
+
+    struct Timer {
+        std::chrono::steady_clock::time_point deadline;
+        std::coroutine_handle<>               handle;
+        bool operator>(const Timer& other) const { return deadline > other.deadline; }
+    };
+
+    void task_started() {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending += 1;
+    }
+
+    void task_done() {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        m_pending -= 1;
+        if(m_pending == 0) m_pending_cv.notify_all();
+    }
+
+    void worker_loop(WorkQueue& queue) {
+        std::function<void()> f;
+        while(queue.pop(f)) f();
+    }
+
+    void timer_loop() {
+        std::unique_lock<std::mutex> lock(m_timer_mutex);
+        while(!m_timer_closed) {
+            if(m_timers.empty()) {
+                m_timer_cv.wait(lock);
+                continue;
+            }
+            auto next = m_timers.top();
+            if(m_timer_cv.wait_until(lock, next.deadline) == std::cv_status::timeout
+            || std::chrono::steady_clock::now() >= next.deadline) {
+                while(!m_timers.empty() && m_timers.top().deadline <= std::chrono::steady_clock::now()) {
+                    auto h = m_timers.top().handle;
+                    m_timers.pop();
+                    m_ready.push([h]() { h.resume(); });
+                }
+            }
+        }
+    }
+
+    WorkQueue                m_ready;
+    WorkQueue                m_io;
+    std::vector<std::thread> m_threads;
+
+    std::mutex               m_pending_mutex;
+    std::condition_variable  m_pending_cv;
+    size_t                   m_pending = 0;
+
+    std::mutex               m_timer_mutex;
+    std::condition_variable  m_timer_cv;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> m_timers;
+    bool                     m_timer_closed = false;
+};
+
+#endif
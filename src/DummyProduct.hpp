@@ -2,18 +2,62 @@
 #define __DUMMY_PRODUCT_H
 
 #include <vector>
+#include <cstring>
+#include <stdexcept>
 #include <boost/serialization/vector.hpp>
 #include <string>
 #include <boost/serialization/string.hpp>
+#include <boost/serialization/array_wrapper.hpp>
+#include <boost/serialization/split_member.hpp>
 
 struct dummy_product {
     std::string data;
+    // when set, the payload lives in memory owned by someone else
+    // (e.g. a node-level shared window) instead of in data
+    char*  external_data     = nullptr;
+    size_t external_size     = 0;
+    size_t external_capacity = 0;
+
+    const char* payload() const {
+        return external_data ? external_data : data.data();
+    }
+
+    size_t size() const {
+        return external_data ? external_size : data.size();
+    }
+
+    bool operator==(const dummy_product& other) const {
+        return size() == other.size()
+            && std::memcmp(payload(), other.payload(), size()) == 0;
+    }
+
+    bool operator!=(const dummy_product& other) const {
+        return !(*this == other);
+    }
+
+    template<typename A>
+    void save(A& ar, const unsigned int version) const {
+        size_t n = size();
+        ar & n;
+        ar & boost::serialization::make_array(payload(), n);
+    }
 
     template<typename A>
-    void serialize(A& ar, const unsigned int version) {
-        ar & data;
+    void load(A& ar, const unsigned int version) {
+        size_t n;
+        ar & n;
+        if(external_data) {
+            if(n > external_capacity)
+                throw std::length_error("product does not fit in external buffer");
+            external_size = n;
+            ar & boost::serialization::make_array(external_data, n);
+        } else {
+            data.resize(n);
+            ar & boost::serialization::make_array(&data[0], n);
+        }
     }
 
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
 
 #endif
@@ -0,0 +1,74 @@
+#ifndef __HUGE_PAGE_BUFFER_H
+#define __HUGE_PAGE_BUFFER_H
+
+#include <string>
+#include <cstdint>
+#include <sys/mman.h>
+
+/**
+ * Anonymous memory region backed by huge pages when possible.
+ * The "explicit" policy asks for hugetlbfs pages (MAP_HUGETLB) and falls
+ * back to transparent huge pages, the "transparent" policy only advises
+ * the kernel (MADV_HUGEPAGE). If neither works, regular pages are used.
+ * backing() tells which one was actually obtained.
+ */
+class HugePageBuffer {
+
+    public:
+
+    static constexpr size_t huge_page_size = 2*1024*1024;
+
+    HugePageBuffer(size_t size, const std::string& policy) {
+        m_size = size;
+        m_mapped_size = ((size + huge_page_size - 1) / huge_page_size) * huge_page_size;
+        if(m_mapped_size == 0) m_mapped_size = huge_page_size;
+#ifdef MAP_HUGETLB
+        if(policy == "explicit") {
+            void* p = mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(p != MAP_FAILED) {
+                m_mapping = p;
+                m_data    = static_cast<char*>(p);
+                m_backing = "hugetlb";
+                return;
+            }
+        }
+#endif
+        // over-allocate so the region can be aligned on a huge page boundary
+        size_t length = m_mapped_size + huge_page_size;
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED) return;
+        m_mapping = p;
+        m_mapped_size = length;
+        uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+        uintptr_t aligned = (addr + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+        m_data = reinterpret_cast<char*>(aligned);
+        m_backing = "default";
+#ifdef MADV_HUGEPAGE
+        if(madvise(m_data, length - (aligned - addr), MADV_HUGEPAGE) == 0)
+            m_backing = "thp";
+#endif
+    }
+
+    HugePageBuffer(const HugePageBuffer&) = delete;
+    HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+
+    ~HugePageBuffer() {
+        if(m_mapping) munmap(m_mapping, m_mapped_size);
+    }
+
+    char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    const std::string& backing() const { return m_backing; }
+
+    private:
+
+    void*       m_mapping     = nullptr;
+    char*       m_data        = nullptr;
+    size_t      m_size        = 0;
+    size_t      m_mapped_size = 0;
+    std::string m_backing     = "none";
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __LRU_PRODUCT_CACHE_H
+#define __LRU_PRODUCT_CACHE_H
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <tuple>
+#include <string>
+#include <hepnos.hpp>
+#include "DummyProduct.hpp"
+
+/**
+ * Client-side LRU cache of loaded products, keyed by
+ * (subrun, event, label) and bounded by the total size of
+ * the cached product data.
+ */
+class LRUProductCache {
+
+    public:
+
+    typedef std::tuple<hepnos::SubRunNumber, hepnos::EventNumber, std::string> key_type;
+
+    LRUProductCache(size_t max_bytes)
+    : m_max_bytes(max_bytes) {}
+
+    /**
+     * Looks up a product, copying it into product on a hit.
+     */
+    bool get(const key_type& key, dummy_product& product) {
+        auto it = m_index.find(key);
+        if(it == m_index.end()) {
+            m_misses += 1;
+            return false;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        product = it->second->second;
+        m_hits += 1;
+        return true;
+    }
+
+    /**
+     * Inserts a product, evicting the least recently used ones
+     * until it fits. Products larger than the cache are not kept.
+     */
+    void put(const key_type& key, const dummy_product& product) {
+        size_t size = product.size();
+        if(size > m_max_bytes) return;
+        auto it = m_index.find(key);
+        if(it != m_index.end()) {
+            m_bytes -= it->second->second.size();
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+        while(m_bytes + size > m_max_bytes) {
+            auto& lru = m_entries.back();
+            m_bytes -= lru.second.size();
+            m_index.erase(lru.first);
+            m_entries.pop_back();
+            m_evictions += 1;
+        }
+        m_entries.emplace_front(key, product);
+        m_index[key] = m_entries.begin();
+        m_bytes += size;
+        m_peak_bytes = std::max(m_peak_bytes, m_bytes);
+    }
+
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+    size_t evictions() const { return m_evictions; }
+    size_t bytes() const { return m_bytes; }
+    size_t peak_bytes() const { return m_peak_bytes; }
+
+    private:
+
+    typedef std::list<std::pair<key_type, dummy_product>> list_type;
+
+    size_t m_max_bytes;
+    size_t m_bytes      = 0;
+    size_t m_peak_bytes = 0;
+    size_t m_hits       = 0;
+    size_t m_misses     = 0;
+    size_t m_evictions  = 0;
+    list_type m_entries;
+    std::map<key_type, list_type::iterator> m_index;
+};
+
+#endif
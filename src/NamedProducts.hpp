@@ -0,0 +1,29 @@
+#ifndef __NAMED_PRODUCTS_H
+#define __NAMED_PRODUCTS_H
+
+#include <string>
+#include <boost/core/demangle.hpp>
+#include "DummyProduct.hpp"
+
+/**
+ * Copies of dummy_product that only differ by the length of their type
+ * name. HEPnOS puts the demangled type name in every product key, so
+ * these let the labels role measure what long C++ type names cost.
+ */
+namespace icarus {
+// kept short on purpose: the shortest type name a real product would plausibly have
+struct lbl_product : dummy_product {};
+
+struct raw_digit_waveform_product : dummy_product {};
+}
+
+namespace icarus { namespace reconstruction { namespace tpc { namespace signal_processing {
+struct deconvolved_wire_waveform_region_of_interest_product : dummy_product {};
+}}}}
+
+template<typename T>
+std::string product_type_name() {
+    return boost::core::demangle(typeid(T).name());
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef __SAMPLE_DUMP_H
+#define __SAMPLE_DUMP_H
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Raw per-operation samples, kept column by column so that recording
+ * is a handful of push_backs and dumping is one write per column.
+ *
+ * A dump file is a sequence of blocks, one per phase:
+ *   magic (u32) version (u32) rank (u32) phase length (u32) phase name
+ *   sample count (u64)
+ *   thread[count] (u32) op[count] (u8) size[count] (u64)
+ *   start[count] end[count] stat1[count] stat2[count] (f64)
+ * Times are seconds since the benchmark's time origin. The meaning of
+ * stat1/stat2 depends on the operation (e.g. storage and serialization
+ * time for stores, loading and deserialization time for loads) and is
+ * NaN when not available. op_process covers round trips made of several
+ * HEPnOS calls (store, compute and load back, or load and derive).
+ * New operations are appended so existing dumps keep their meaning.
+ */
+enum sample_op : uint8_t {
+    op_other = 0,
+    op_store,
+    op_load,
+    op_lookup,
+    op_process,
+    op_create
+};
+
+static const char* const sample_op_names[] = { "other", "store", "load", "lookup", "process", "create" };
+
+struct sample_columns {
+
+    static constexpr uint32_t magic   = 0x504d5348; // "HSMP"
+    static constexpr uint32_t version = 1;
+
+    std::vector<uint32_t> thread;
+    std::vector<uint8_t>  op;
+    std::vector<uint64_t> size;
+    std::vector<double>   start;
+    std::vector<double>   end;
+    std::vector<double>   stat1;
+    std::vector<double>   stat2;
+
+    size_t count() const { return start.size(); }
+
+    void push(uint32_t t, uint8_t o, uint64_t s, double t0, double t1, double s1, double s2) {
+        thread.push_back(t);
+        op.push_back(o);
+        size.push_back(s);
+        start.push_back(t0);
+        end.push_back(t1);
+        stat1.push_back(s1);
+        stat2.push_back(s2);
+    }
+
+    void append(const sample_columns& other) {
+        thread.insert(thread.end(), other.thread.begin(), other.thread.end());
+        op.insert(op.end(), other.op.begin(), other.op.end());
+        size.insert(size.end(), other.size.begin(), other.size.end());
+        start.insert(start.end(), other.start.begin(), other.start.end());
+        end.insert(end.end(), other.end.begin(), other.end.end());
+        stat1.insert(stat1.end(), other.stat1.begin(), other.stat1.end());
+        stat2.insert(stat2.end(), other.stat2.begin(), other.stat2.end());
+    }
+
+    /**
+     * Small integer identifying the calling thread.
+     */
+    static uint32_t thread_index() {
+        static std::atomic<uint32_t> next(0);
+        thread_local uint32_t index = next++;
+        return index;
+    }
+
+    void write(std::ostream& os, uint32_t rank, const std::string& phase) const {
+        uint32_t header[4] = { magic, version, rank, (uint32_t)phase.size() };
+        uint64_t n = count();
+        os.write(reinterpret_cast<const char*>(header), sizeof(header));
+        os.write(phase.data(), phase.size());
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        write_column(os, thread);
+        write_column(os, op);
+        write_column(os, size);
+        write_column(os, start);
+        write_column(os, end);
+        write_column(os, stat1);
+        write_column(os, stat2);
+    }
+
+    /**
+     * Reads the next block, returns false at the end of the
+     * stream or if the block is malformed.
+     */
+    bool read(std::istream& is, uint32_t& rank, std::string& phase) {
+        uint32_t header[4];
+        uint64_t n;
+        if(!is.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+        if(header[0] != magic || header[1] != version) return false;
+        rank = header[2];
+        phase.resize(header[3]);
+        if(!is.read(&phase[0], phase.size())) return false;
+        if(!is.read(reinterpret_cast<char*>(&n), sizeof(n))) return false;
+        return read_column(is, thread, n) && read_column(is, op, n) && read_column(is, size, n)
+            && read_column(is, start, n) && read_column(is, end, n)
+            && read_column(is, stat1, n) && read_column(is, stat2, n);
+    }
+
+    private:
+
+    template<typename T>
+    static void write_column(std::ostream& os, const std::vector<T>& column) {
+        os.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    }
+
+    template<typename T>
+    static bool read_column(std::istream& is, std::vector<T>& column, uint64_t n) {
+        column.resize(n);
+        return (bool)is.read(reinterpret_cast<char*>(column.data()), n * sizeof(T));
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <tclap/CmdLine.h>
+#include "SampleDump.hpp"
+
+/**
+ * Reads the per-rank sample files written by hepnos-icarus-benchmark
+ * with --dump-samples and merges them, either into a single CSV stream
+ * sorted by start time, or into per-phase/per-op latency percentiles.
+ */
+
+struct sample_block {
+    uint32_t       rank;
+    std::string    phase;
+    sample_columns samples;
+};
+
+static std::vector<sample_block> read_files(const std::vector<std::string>& files);
+static void print_csv(const std::vector<sample_block>& blocks);
+static void print_summary(const std::vector<sample_block>& blocks);
+
+int main(int argc, char** argv) {
+    std::vector<std::string> files;
+    bool csv = false;
+    try {
+        TCLAP::CmdLine cmd("Merge HEPnOS ICARUS benchmark sample dumps", ' ', "0.6");
+        TCLAP::SwitchArg csvOutput("", "csv",
+            "Output every sample as CSV sorted by start time instead of a summary", false);
+        TCLAP::UnlabeledMultiArg<std::string> inputFiles("files",
+            "Sample files written with --dump-samples", true, "file");
+        cmd.add(csvOutput);
+        cmd.add(inputFiles);
+        cmd.parse(argc, argv);
+        files = inputFiles.getValue();
+        csv   = csvOutput.getValue();
+    } catch(TCLAP::ArgException &e) {
+        std::cerr << e.error() << " for command-line argument " << e.argId() << std::endl;
+        return 1;
+    }
+
+    auto blocks = read_files(files);
+    if(csv) print_csv(blocks);
+    else print_summary(blocks);
+    return 0;
+}
+
+static std::vector<sample_block> read_files(const std::vector<std::string>& files) {
+    std::vector<sample_block> blocks;
+    for(const auto& filename : files) {
+        std::ifstream ifs(filename, std::ios::binary);
+        if(!ifs.good()) {
+            std::cerr << "Could not open " << filename << std::endl;
+            continue;
+        }
+        while(true) {
+            sample_block block;
+            if(!block.samples.read(ifs, block.rank, block.phase)) break;
+            blocks.push_back(std::move(block));
+        }
+        if(!ifs.eof()) {
+            std::cerr << "Malformed block in " << filename << std::endl;
+        }
+    }
+    return blocks;
+}
+
+static const char* op_name(uint8_t op) {
+    return op < sizeof(sample_op_names)/sizeof(sample_op_names[0]) ? sample_op_names[op] : "unknown";
+}
+
+static void print_csv(const std::vector<sample_block>& blocks) {
+    // (block, sample) pairs sorted by start time across all ranks
+    std::vector<std::pair<uint32_t, uint64_t>> order;
+    for(uint32_t b = 0; b < blocks.size(); b++)
+        for(uint64_t i = 0; i < blocks[b].samples.count(); i++)
+            order.emplace_back(b, i);
+    std::sort(order.begin(), order.end(), [&blocks](const std::pair<uint32_t, uint64_t>& x,
+                                                    const std::pair<uint32_t, uint64_t>& y) {
+        return blocks[x.first].samples.start[x.second] < blocks[y.first].samples.start[y.second];
+    });
+    std::printf("rank,phase,thread,op,size,start,end,stat1,stat2\n");
+    for(const auto& entry : order) {
+        const auto& block = blocks[entry.first];
+        const auto& s = block.samples;
+        auto i = entry.second;
+        std::printf("%u,%s,%u,%s,%llu,%.9f,%.9f,%.9g,%.9g\n", block.rank, block.phase.c_str(),
+                    s.thread[i], op_name(s.op[i]), (unsigned long long)s.size[i],
+                    s.start[i], s.end[i], s.stat1[i], s.stat2[i]);
+    }
+}
+
+static void print_summary(const std::vector<sample_block>& blocks) {
+    struct group {
+        std::vector<double> latencies;
+        uint64_t bytes = 0;
+        double   first = 0.0;
+        double   last  = 0.0;
+    };
+    std::map<std::pair<std::string, std::string>, group> groups;
+    for(const auto& block : blocks) {
+        const auto& s = block.samples;
+        for(uint64_t i = 0; i < s.count(); i++) {
+            auto& g = groups[{ block.phase, op_name(s.op[i]) }];
+            if(g.latencies.empty() || s.start[i] < g.first) g.first = s.start[i];
+            if(g.latencies.empty() || s.end[i] > g.last) g.last = s.end[i];
+            g.latencies.push_back(s.end[i] - s.start[i]);
+            g.bytes += s.size[i];
+        }
+    }
+    std::printf("%-24s %-8s %12s %14s %12s %12s %12s %12s %12s\n", "phase", "op", "samples",
+                "bytes", "span(s)", "mean(s)", "p50(s)", "p99(s)", "max(s)");
+    for(auto& entry : groups) {
+        auto& l = entry.second.latencies;
+        std::sort(l.begin(), l.end());
+        double mean = std::accumulate(l.begin(), l.end(), 0.0) / l.size();
+        auto percentile = [&l](double p) { return l[std::min(l.size() - 1, (size_t)(p * l.size()))]; };
+        std::printf("%-24s %-8s %12zu %14llu %12.6f %12.9f %12.9f %12.9f %12.9f\n",
+                    entry.first.first.c_str(), entry.first.second.c_str(), l.size(),
+                    (unsigned long long)entry.second.bytes, entry.second.last - entry.second.first,
+                    mean, percentile(0.5), percentile(0.99), l.back());
+    }
+}